@@ -1,4 +1,4 @@
-/* aes.h - TinyCrypt interface to an AES-128 implementation */
+/* aes.h - TinyCrypt interface to an AES implementation */
 
 /*
  *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
@@ -32,18 +32,24 @@
 
 /**
  * @file
- * @brief -- Interface to an AES-128 implementation.
+ * @brief -- Interface to an AES implementation.
  *
- *  Overview:   AES-128 is a NIST approved block cipher specified in
+ *  Overview:   AES is a NIST approved block cipher specified in
  *              FIPS 197. Block ciphers are deterministic algorithms that
  *              perform a transformation specified by a symmetric key in fixed-
- *              length data sets, also called blocks.
+ *              length data sets, also called blocks. AES accepts 128, 192
+ *              and 256-bit keys, which are processed in 10, 12 and 14 rounds
+ *              respectively.
  *
- *  Security:   AES-128 provides approximately 128 bits of security.
+ *  Security:   AES-128 provides approximately 128 bits of security, AES-192
+ *              and AES-256 approximately 192 and 256 bits.
  *
- *  Usage:      1) call tc_aes128_set_encrypt/decrypt_key to set the key.
+ *  Usage:      1) call tc_aes128/192/256_set_encrypt/decrypt_key to set the
+ *              key.
  *
- *              2) call tc_aes_encrypt/decrypt to process the data.
+ *              2) call tc_aes_encrypt/decrypt to process the data, or
+ *              tc_aes_encrypt/decrypt_blocks to process several blocks
+ *              at once.
  */
 
 #ifndef __TC_AES_H__
@@ -56,32 +62,103 @@ extern "C" {
 #endif
 
 #define Nb (4)  /* number of columns (32-bit words) comprising the state */
-#define Nk (4)  /* number of 32-bit words comprising the key */
-#define Nr (10) /* number of rounds */
+#define Nk (4)  /* number of 32-bit words comprising an AES-128 key */
+#define Nr (10) /* number of rounds of AES-128 */
 #define TC_AES_BLOCK_SIZE (Nb*Nk)
 #define TC_AES_KEY_SIZE (Nb*Nk)
 
+/* key sizes in bytes of AES-192 and AES-256 */
+#define TC_AES192_KEY_SIZE (24)
+#define TC_AES256_KEY_SIZE (32)
+
+/*
+ * Number of rounds a key schedule has room for. It defaults to those of
+ * AES-128, keeping the schedule at 176 bytes of round keys; defining it to
+ * 14, as the TINYCRYPT_AES_192_256 Kconfig option does, grows every
+ * schedule to 240 bytes so that it may also hold AES-192 and AES-256 keys.
+ * Setting a key needing more rounds fails; on-the-fly keys, which store
+ * no schedule, are not limited.
+ */
+#ifndef TC_AES_MAX_ROUNDS
+#define TC_AES_MAX_ROUNDS (Nr)
+#endif
+
+/*
+ * number of blocks the multi-block procedures are able to process in
+ * parallel; callers batching work for them should use multiples of it
+ */
+#define TC_AES_PARALLEL_BLOCKS (8)
+
 typedef struct tc_aes_key_sched_struct {
-	unsigned int words[Nb*(Nr+1)];
+	unsigned int rounds; /* 10, 12 or 14, set along with the round keys */
+	unsigned int words[Nb*(TC_AES_MAX_ROUNDS+1)];
 } *TCAesKeySched_t;
 
+/*
+ * On-the-fly keys keep only Nk key words instead of the whole schedule;
+ * the round keys are derived again inside every block operation. The
+ * struct starts like tc_aes_key_sched_struct, with TC_AES_OTF set in its
+ * rounds, so that a pointer to it cast to TCAesKeySched_t may be passed to
+ * tc_aes_encrypt/decrypt, their multi-block variants and every mode.
+ * Only the byte-oriented engine provides them.
+ */
+#define TC_AES_OTF (0x100)
+
+typedef struct tc_aes_otf_key_struct {
+	unsigned int rounds; /* 10, 12 or 14, or'ed with TC_AES_OTF */
+	unsigned int words[TC_AES256_KEY_SIZE/Nb];
+} *TCAesOtfKey_t;
+
 /**
  *  @brief Set AES-128 encryption key
  *  Uses key k to initialize s
  *  @return  returns TC_CRYPTO_SUCCESS (1)
  *           returns TC_CRYPTO_FAIL (0) if: s == NULL or k == NULL
- *  @note       This implementation skips the additional steps required for keys
- *              larger than 128 bits, and must not be used for AES-192 or
- *              AES-256 key schedule -- see FIPS 197 for details
  *  @param      s IN/OUT -- initialized struct tc_aes_key_sched_struct
  *  @param      k IN -- points to the AES key
  */
 int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k);
 
 /**
- *  @brief AES-128 Encryption procedure
+ *  @brief Set AES-192 encryption key
+ *  Uses the TC_AES192_KEY_SIZE byte key k to initialize s
+ *  @return  returns TC_CRYPTO_SUCCESS (1)
+ *           returns TC_CRYPTO_FAIL (0) if: s == NULL or k == NULL or
+ *              TC_AES_MAX_ROUNDS < 12
+ *  @param      s IN/OUT -- initialized struct tc_aes_key_sched_struct
+ *  @param      k IN -- points to the AES key
+ */
+int tc_aes192_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k);
+
+/**
+ *  @brief Set AES-256 encryption key
+ *  Uses the TC_AES256_KEY_SIZE byte key k to initialize s
+ *  @return  returns TC_CRYPTO_SUCCESS (1)
+ *           returns TC_CRYPTO_FAIL (0) if: s == NULL or k == NULL or
+ *              TC_AES_MAX_ROUNDS < 14
+ *  @param      s IN/OUT -- initialized struct tc_aes_key_sched_struct
+ *  @param      k IN -- points to the AES key
+ */
+int tc_aes256_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k);
+
+/**
+ *  @brief Set an on-the-fly AES-128, AES-192 or AES-256 encryption key
+ *  Stores key k in o, to be expanded on the fly by every block encrypted
+ *  @return  returns TC_CRYPTO_SUCCESS (1)
+ *           returns TC_CRYPTO_FAIL (0) if: o == NULL or k == NULL
+ *  @note       Trades a 36 byte key for a full key expansion per block,
+ *              which suits keys used for a few blocks at a time
+ *  @param      o IN/OUT -- struct tc_aes_otf_key_struct to initialize
+ *  @param      k IN -- points to the AES key
+ */
+int tc_aes128_set_encrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k);
+int tc_aes192_set_encrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k);
+int tc_aes256_set_encrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k);
+
+/**
+ *  @brief AES Encryption procedure
  *  Encrypts contents of in buffer into out buffer under key;
- *              schedule s
+ *              schedule s, with the number of rounds of its key size
  *  @note Assumes s was initialized by aes_set_encrypt_key;
  *              out and in point to 16 byte buffers
  *  @return  returns TC_CRYPTO_SUCCESS (1)
@@ -93,28 +170,126 @@ int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k);
 int tc_aes_encrypt(uint8_t *out, const uint8_t *in, 
 		   const TCAesKeySched_t s);
 
+/**
+ *  @brief AES multi-block Encryption procedure
+ *  Encrypts nblocks consecutive blocks of in buffer into out buffer under key
+ *              schedule s, each block independently of the others
+ *  @note Assumes s was initialized by aes_set_encrypt_key;
+ *              out and in point to nblocks * 16 byte buffers, which are
+ *              either identical or do not overlap
+ *  @return  returns TC_CRYPTO_SUCCESS (1)
+ *           returns TC_CRYPTO_FAIL (0) if: out == NULL or in == NULL or s == NULL
+ *  @param out IN/OUT -- buffer to receive the ciphertext blocks
+ *  @param in IN -- plaintext blocks to encrypt
+ *  @param nblocks IN -- number of blocks to encrypt
+ *  @param s IN -- initialized AES key schedule
+ */
+int tc_aes_encrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s);
+
 /**
  *  @brief Set the AES-128 decryption key
  *  Uses key k to initialize s
  *  @return returns TC_CRYPTO_SUCCESS (1)
  *          returns TC_CRYPTO_FAIL (0) if: s == NULL or k == NULL
- *  @note       This is the implementation of the straightforward inverse cipher
- *              using the cipher documented in FIPS-197 figure 12, not the
- *              equivalent inverse cipher presented in Figure 15
- *  @warning    This routine skips the additional steps required for keys larger
- *              than 128, and must not be used for AES-192 or AES-256 key
- *              schedule -- see FIPS 197 for details
+ *  @note       The byte-oriented and T-table engines implement the
+ *              equivalent inverse cipher presented in FIPS-197 Figure 15, so
+ *              the resulting schedule differs from the encryption one and is
+ *              only valid for tc_aes_decrypt
  *  @param s  IN/OUT -- initialized struct tc_aes_key_sched_struct
  *  @param k  IN -- points to the AES key
  */
 int tc_aes128_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k);
 
 /**
- *  @brief AES-128 Encryption procedure
+ *  @brief Set the AES-192 decryption key
+ *  Uses the TC_AES192_KEY_SIZE byte key k to initialize s
+ *  @return returns TC_CRYPTO_SUCCESS (1)
+ *          returns TC_CRYPTO_FAIL (0) if: s == NULL or k == NULL or
+ *              TC_AES_MAX_ROUNDS < 12
+ *  @note       See tc_aes128_set_decrypt_key
+ *  @param s  IN/OUT -- initialized struct tc_aes_key_sched_struct
+ *  @param k  IN -- points to the AES key
+ */
+int tc_aes192_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k);
+
+/**
+ *  @brief Set the AES-256 decryption key
+ *  Uses the TC_AES256_KEY_SIZE byte key k to initialize s
+ *  @return returns TC_CRYPTO_SUCCESS (1)
+ *          returns TC_CRYPTO_FAIL (0) if: s == NULL or k == NULL or
+ *              TC_AES_MAX_ROUNDS < 14
+ *  @note       See tc_aes128_set_decrypt_key
+ *  @param s  IN/OUT -- initialized struct tc_aes_key_sched_struct
+ *  @param k  IN -- points to the AES key
+ */
+int tc_aes256_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k);
+
+/*
+ * Key pair holding the encryption and the decryption schedules of one key,
+ * for users of both directions such as CBC decryption with CMAC.
+ */
+typedef struct tc_aes_key_pair_struct {
+	struct tc_aes_key_sched_struct enc; /* for tc_aes_encrypt */
+	struct tc_aes_key_sched_struct dec; /* for tc_aes_decrypt */
+} *TCAesKeyPair_t;
+
+/**
+ *  @brief Set an AES-128, AES-192 or AES-256 key pair
+ *  Uses key k to initialize both schedules of p, deriving the decryption
+ *  schedule from the encryption one instead of expanding k a second time
+ *  @return returns TC_CRYPTO_SUCCESS (1)
+ *          returns TC_CRYPTO_FAIL (0) if: p == NULL or k == NULL or
+ *              the key needs more than TC_AES_MAX_ROUNDS rounds
+ *  @param p  IN/OUT -- struct tc_aes_key_pair_struct to initialize
+ *  @param k  IN -- points to the AES key
+ */
+int tc_aes128_set_key_pair(TCAesKeyPair_t p, const uint8_t *k);
+int tc_aes192_set_key_pair(TCAesKeyPair_t p, const uint8_t *k);
+int tc_aes256_set_key_pair(TCAesKeyPair_t p, const uint8_t *k);
+
+/**
+ *  @brief Set n AES-128, AES-192 or AES-256 keys at once
+ *  Expands the n keys stored one after the other at k into enc[0..n-1]
+ *  and, unless dec is NULL, derives their decryption schedules into
+ *  dec[0..n-1]. The constant-time engines share their S-box passes among
+ *  the keys, which makes setting up many keys much cheaper
+ *  @return returns TC_CRYPTO_SUCCESS (1)
+ *          returns TC_CRYPTO_FAIL (0) if: enc == NULL or k == NULL or
+ *              the keys need more than TC_AES_MAX_ROUNDS rounds
+ *  @note   The schedules are identical to those set one key at a time;
+ *          enc and dec must not overlap
+ *  @param enc IN/OUT -- array of n struct tc_aes_key_sched_struct
+ *  @param dec IN/OUT -- array of n struct tc_aes_key_sched_struct, or NULL
+ *  @param k   IN -- points to the n AES keys
+ *  @param n   IN -- number of keys
+ */
+int tc_aes128_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n);
+int tc_aes192_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n);
+int tc_aes256_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n);
+
+/**
+ *  @brief Set an on-the-fly AES-128, AES-192 or AES-256 decryption key
+ *  Stores the last key words of the expansion of k in o, from which every
+ *  block decrypted expands the round keys backwards
+ *  @return  returns TC_CRYPTO_SUCCESS (1)
+ *           returns TC_CRYPTO_FAIL (0) if: o == NULL or k == NULL
+ *  @param      o IN/OUT -- struct tc_aes_otf_key_struct to initialize
+ *  @param      k IN -- points to the AES key
+ */
+int tc_aes128_set_decrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k);
+int tc_aes192_set_decrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k);
+int tc_aes256_set_decrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k);
+
+/**
+ *  @brief AES Decryption procedure
  *  Decrypts in buffer into out buffer under key schedule s
  *  @return returns TC_CRYPTO_SUCCESS (1)
  *          returns TC_CRYPTO_FAIL (0) if: out is NULL or in is NULL or s is NULL
- *  @note   Assumes s was initialized by aes_set_encrypt_key
+ *  @note   Assumes s was initialized by aes_set_decrypt_key
  *          out and in point to 16 byte buffers
  *  @param out IN/OUT -- buffer to receive ciphertext block
  *  @param in IN -- a plaintext block to encrypt
@@ -123,6 +298,51 @@ int tc_aes128_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k);
 int tc_aes_decrypt(uint8_t *out, const uint8_t *in, 
 		   const TCAesKeySched_t s);
 
+/**
+ *  @brief AES multi-block Decryption procedure
+ *  Decrypts nblocks consecutive blocks of in buffer into out buffer under key
+ *              schedule s, each block independently of the others
+ *  @note Assumes s was initialized by aes_set_decrypt_key;
+ *              out and in point to nblocks * 16 byte buffers, which are
+ *              either identical or do not overlap
+ *  @return  returns TC_CRYPTO_SUCCESS (1)
+ *           returns TC_CRYPTO_FAIL (0) if: out == NULL or in == NULL or s == NULL
+ *  @param out IN/OUT -- buffer to receive the plaintext blocks
+ *  @param in IN -- ciphertext blocks to decrypt
+ *  @param nblocks IN -- number of blocks to decrypt
+ *  @param s IN -- initialized AES key schedule
+ */
+int tc_aes_decrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s);
+
+/*
+ * One entry of a multi-key batch: a short run of blocks under its own key.
+ * The engines spread the blocks of all entries over their parallel lanes,
+ * so that packets under different keys are processed side by side.
+ */
+typedef struct tc_aes_job_struct {
+	TCAesKeySched_t sched; /* schedule of this entry */
+	const uint8_t *in;     /* nblocks * 16 bytes to process */
+	uint8_t *out;          /* receives nblocks * 16 bytes */
+	unsigned int nblocks;  /* number of blocks, usually 1 */
+} *TCAesJob_t;
+
+/**
+ *  @brief AES multi-key Encryption and Decryption procedures
+ *  Encrypt (decrypt) the blocks of each of the njobs entries of jobs under
+ *              the schedule of that entry
+ *  @note Assumes every schedule was initialized by aes_set_encrypt_key
+ *              (aes_set_decrypt_key); the out buffer of an entry is either
+ *              identical to its in buffer or overlaps no buffer of the batch
+ *  @return  returns TC_CRYPTO_SUCCESS (1)
+ *           returns TC_CRYPTO_FAIL (0) if: jobs == NULL or the sched, in or
+ *              out pointer of an entry is NULL, before processing any entry
+ *  @param jobs IN/OUT -- array of the entries to process
+ *  @param njobs IN -- number of entries
+ */
+int tc_aes_encrypt_jobs(const TCAesJob_t jobs, unsigned int njobs);
+int tc_aes_decrypt_jobs(const TCAesJob_t jobs, unsigned int njobs);
+
 #ifdef __cplusplus
 }
 #endif
@@ -69,6 +69,19 @@
  *
  *            2) call tc_cbc_mode_decrypt to decrypt data.
  *
+ *            3) to process a message in fragments, call tc_cbc_init once,
+ *            then tc_cbc_encrypt_update or tc_cbc_decrypt_update for each
+ *            block aligned fragment, and tc_cbc_final at the end. The IV is
+ *            neither prepended nor expected in front of the ciphertext,
+ *            and the fragments may be processed in place.
+ *
+ *            4) call tc_cbc_mode_encrypt_multi to encrypt a batch of
+ *            independent messages at once.
+ *
+ *            5) call tc_cbc_mode_decrypt_mt to decrypt a large buffer on
+ *            several threads; it is only available when TinyCrypt is built
+ *            with thread support.
+ *
  */
 
 #ifndef __TC_CBC_MODE_H__
@@ -144,6 +157,137 @@ int tc_cbc_mode_decrypt(uint8_t *out, unsigned int outlen, const uint8_t *in,
 			unsigned int inlen, const uint8_t *iv,
 			const TCAesKeySched_t sched);
 
+/* struct tc_cbc_struct represents the state of a streaming CBC computation */
+typedef struct tc_cbc_struct {
+/* chaining block: the iv, then the last ciphertext block processed */
+	uint8_t iv[TC_AES_BLOCK_SIZE];
+/* AES key schedule */
+	TCAesKeySched_t sched;
+} *TCCbcState_t;
+
+/**
+ * @brief Initializes a streaming CBC computation
+ * @return returns TC_CRYPTO_SUCCESS (1) after having initialized the CBC state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL or
+ *              iv == NULL or
+ *              sched == NULL
+ * @param s OUT -- the state to initialize
+ * @param iv IN -- the IV of the message
+ * @param sched IN -- AES key schedule, configured by aes_set_encrypt_key to
+ *                    encrypt or by aes_set_decrypt_key to decrypt, which must
+ *                    remain valid until tc_cbc_final
+ */
+int tc_cbc_init(TCCbcState_t s, const uint8_t *iv,
+		const TCAesKeySched_t sched);
+
+/**
+ * @brief Encrypts the next fragment of a message
+ * @return returns TC_CRYPTO_SUCCESS (1) after having encrypted the fragment
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL or
+ *              out == NULL or in == NULL when len > 0 or
+ *              (len % TC_AES_BLOCK_SIZE) != 0
+ * @note out and in are either identical or do not overlap
+ * @param s IN/OUT -- the CBC state
+ * @param out OUT -- buffer to receive the len bytes of ciphertext
+ * @param in IN -- plaintext to encrypt
+ * @param len IN -- length of the fragment in bytes
+ */
+int tc_cbc_encrypt_update(TCCbcState_t s, uint8_t *out, const uint8_t *in,
+			  unsigned int len);
+
+/**
+ * @brief Decrypts the next fragment of a message
+ * @return returns TC_CRYPTO_SUCCESS (1) after having decrypted the fragment
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL or
+ *              out == NULL or in == NULL when len > 0 or
+ *              (len % TC_AES_BLOCK_SIZE) != 0
+ * @note out and in are either identical or do not overlap
+ * @param s IN/OUT -- the CBC state
+ * @param out OUT -- buffer to receive the len bytes of plaintext
+ * @param in IN -- ciphertext to decrypt
+ * @param len IN -- length of the fragment in bytes
+ */
+int tc_cbc_decrypt_update(TCCbcState_t s, uint8_t *out, const uint8_t *in,
+			  unsigned int len);
+
+/**
+ * @brief Ends a streaming CBC computation and erases the CBC state
+ * @return returns TC_CRYPTO_SUCCESS (1) after having erased the CBC state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL
+ * @param iv OUT -- if not NULL, receives the chaining block, from which a
+ *                  later computation may continue the message
+ * @param s IN/OUT -- the CBC state
+ */
+int tc_cbc_final(uint8_t *iv, TCCbcState_t s);
+
+/*
+ * One message of a multi-buffer CBC encryption batch: the len bytes of in
+ * are encrypted into the len bytes of out under sched, chained from iv,
+ * which is updated to the last ciphertext block
+ */
+typedef struct tc_cbc_job_struct {
+	uint8_t *out;
+	const uint8_t *in;
+	unsigned int len;
+	uint8_t *iv;
+	TCAesKeySched_t sched;
+} *TCCbcJob_t;
+
+/**
+ * @brief Multi-buffer CBC encryption procedure
+ * Encrypts the njobs messages of jobs, each under its own key, advancing
+ * them in lockstep so that the next block of every message is encrypted
+ * side by side through tc_aes_encrypt_jobs; CBC encryption being serial
+ * within a message, this keeps a multi-lane AES engine busy
+ * @return returns TC_CRYPTO_SUCCESS (1)
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                jobs == NULL or
+ *                the out, in, iv or sched pointer of a message is NULL or
+ *                the len of a message is not a multiple of TC_AES_BLOCK_SIZE
+ * @note Unlike tc_cbc_mode_encrypt, the iv is not prepended to out; out of
+ *       a message is either identical to its in or overlaps no buffer of
+ *       the batch, and messages of zero length are left untouched
+ * @param jobs IN/OUT -- array of the messages to encrypt
+ * @param njobs IN -- number of messages
+ */
+int tc_cbc_mode_encrypt_multi(const TCCbcJob_t jobs, unsigned int njobs);
+
+/* default number of bytes per chunk of tc_cbc_mode_decrypt_mt */
+#define TC_CBC_MT_CHUNK (64 * 1024)
+
+/* default number of threads of tc_cbc_mode_decrypt_mt */
+#define TC_CBC_MT_THREADS 4
+
+/**
+ * @brief Multi-threaded CBC decryption procedure
+ * Decrypts as tc_cbc_mode_decrypt, with the input split into chunks of
+ * whole blocks decrypted by a pool of worker threads, each chunk being
+ * chained to the last ciphertext block of the one before it
+ * @return returns TC_CRYPTO_SUCCESS (1)
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                tc_cbc_mode_decrypt would fail on the same input or
+ *                the worker threads could not be synchronized
+ * @note Assumes the same as tc_cbc_mode_decrypt; out may not overlap in
+ * @param out IN/OUT -- buffer to receive decrypted data
+ * @param outlen IN -- length of plaintext buffer in bytes
+ * @param in IN -- ciphertext to decrypt, including IV
+ * @param inlen IN -- length of ciphertext buffer in bytes
+ * @param iv IN -- the IV for the this encrypt/decrypt
+ * @param sched IN --  AES key schedule for this decrypt
+ * @param chunk IN -- bytes per chunk, rounded down to whole blocks, or 0 for
+ *                    TC_CBC_MT_CHUNK
+ * @param nthreads IN -- number of threads, including the calling one, up to
+ *                       TC_PARALLEL_MAX_THREADS, or 0 for TC_CBC_MT_THREADS
+ */
+int tc_cbc_mode_decrypt_mt(uint8_t *out, unsigned int outlen,
+			   const uint8_t *in, unsigned int inlen,
+			   const uint8_t *iv, const TCAesKeySched_t sched,
+			   unsigned int chunk, unsigned int nthreads);
+
 #ifdef __cplusplus
 }
 #endif
@@ -69,6 +69,17 @@
  *            2) call tc_ccm_mode_encrypt to encrypt data and generate tag.
  *
  *            3) call tc_ccm_mode_decrypt to decrypt data and verify tag.
+ *
+ *            4) to process a message in chunks, call tc_ccm_init with the
+ *            total lengths, tc_ccm_update_aad for each chunk of associated
+ *            data, then tc_ccm_encrypt_update (tc_ccm_decrypt_update) for
+ *            each chunk of payload, and tc_ccm_final to generate the tag
+ *            (tc_ccm_verify to verify it). The state has a fixed size, and
+ *            the counter field may be 2 to 8 bytes long, for payloads of up
+ *            to 2^(8q) bytes; the nonce is then 15 - q bytes long.
+ *
+ *            5) call tc_ccm_seal_batch (tc_ccm_open_batch) to process a
+ *            batch of packets under one key at once.
  */
 
 #ifndef __TC_CCM_MODE_H__
@@ -204,6 +215,167 @@ int tc_ccm_decryption_verification(uint8_t *out, unsigned int olen,
 				   unsigned int alen, const uint8_t *payload, unsigned int plen,
 				   TCCcmMode_t c);
 
+/* struct tc_ccm_state_struct represents a streaming CCM computation */
+typedef struct tc_ccm_state_struct {
+/* CBC-MAC block, then keystream of the current payload block */
+	uint8_t blocks[2 * TC_AES_BLOCK_SIZE];
+/* counter block of the current payload block */
+	uint8_t ctr[TC_AES_BLOCK_SIZE];
+/* associated data bytes still expected */
+	uint64_t alen;
+/* payload bytes still expected */
+	uint64_t plen;
+/* bytes of the CBC-MAC block filled; a full one is encrypted when needed */
+	unsigned int offset;
+/* length in bytes of the counter field (parameter q in SP-800 38C) */
+	unsigned int q;
+/* mac length in bytes (parameter t in SP-800 38C) */
+	unsigned int mlen;
+/* AES key schedule */
+	TCAesKeySched_t sched;
+} *TCCcmState_t;
+
+/**
+ * @brief Initializes a streaming CCM computation
+ * @return returns TC_CRYPTO_SUCCESS (1) after having initialized the state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                s == NULL or
+ *                c == NULL or
+ *                q < 2 or q > 8 or
+ *                plen >= 2^(8q)
+ * @param s OUT -- the state to initialize
+ * @param c IN -- CCM state configured by tc_ccm_config, of whose nonce the
+ *                first 15 - q bytes are used; its schedule must remain valid
+ *                until tc_ccm_final or tc_ccm_verify
+ * @param q IN -- length in bytes of the counter field
+ * @param alen IN -- total associated data length in bytes
+ * @param plen IN -- total payload length in bytes
+ */
+int tc_ccm_init(TCCcmState_t s, const TCCcmMode_t c, unsigned int q,
+		uint64_t alen, uint64_t plen);
+
+/**
+ * @brief Authenticates the next chunk of associated data
+ * @return returns TC_CRYPTO_SUCCESS (1) after having processed the chunk
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                s == NULL or
+ *                data == NULL when len > 0 or
+ *                len exceeds the associated data still expected
+ * @param s IN/OUT -- the CCM state
+ * @param data IN -- the next chunk of associated data
+ * @param len IN -- length of the chunk in bytes
+ */
+int tc_ccm_update_aad(TCCcmState_t s, const uint8_t *data, size_t len);
+
+/**
+ * @brief Encrypts and authenticates the next chunk of payload
+ * @return returns TC_CRYPTO_SUCCESS (1) after having processed the chunk
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                s == NULL or
+ *                out == NULL or in == NULL when len > 0 or
+ *                associated data is still expected or
+ *                len exceeds the payload still expected
+ * @note out and in are either identical or do not overlap
+ * @param s IN/OUT -- the CCM state
+ * @param out OUT -- buffer to receive the len bytes of ciphertext
+ * @param in IN -- the next chunk of plaintext
+ * @param len IN -- length of the chunk in bytes
+ */
+int tc_ccm_encrypt_update(TCCcmState_t s, uint8_t *out, const uint8_t *in,
+			  size_t len);
+
+/**
+ * @brief Decrypts and authenticates the next chunk of payload
+ * @return returns TC_CRYPTO_SUCCESS (1) after having processed the chunk
+ *         returns TC_CRYPTO_FAIL (0) as tc_ccm_encrypt_update
+ * @warning The plaintext is released before the tag is verified; it may
+ *          not be acted upon before tc_ccm_verify succeeds
+ * @note out and in are either identical or do not overlap
+ * @param s IN/OUT -- the CCM state
+ * @param out OUT -- buffer to receive the len bytes of plaintext
+ * @param in IN -- the next chunk of ciphertext
+ * @param len IN -- length of the chunk in bytes
+ */
+int tc_ccm_decrypt_update(TCCcmState_t s, uint8_t *out, const uint8_t *in,
+			  size_t len);
+
+/**
+ * @brief Generates the tag of an encrypted message and erases the state
+ * @return returns TC_CRYPTO_SUCCESS (1) after having generated the tag
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                tag == NULL or
+ *                s == NULL or
+ *                associated data or payload is still expected
+ * @param tag OUT -- buffer to receive the mlen bytes of tag
+ * @param s IN/OUT -- the CCM state
+ */
+int tc_ccm_final(uint8_t *tag, TCCcmState_t s);
+
+/**
+ * @brief Verifies the tag of a decrypted message and erases the state
+ * @return returns TC_CRYPTO_SUCCESS (1) if the tag is valid
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                tag == NULL or
+ *                s == NULL or
+ *                associated data or payload is still expected or
+ *                the tag is invalid
+ * @param tag IN -- the mlen bytes of received tag
+ * @param s IN/OUT -- the CCM state
+ */
+int tc_ccm_verify(const uint8_t *tag, TCCcmState_t s);
+
+/*
+ * One packet of a CCM batch, processed as by tc_ccm_generation_encryption
+ * (tc_ccm_decryption_verification) under its own 13 byte nonce
+ */
+typedef struct tc_ccm_packet_struct {
+	uint8_t *out; /* output buffer */
+	unsigned int olen; /* output buffer length in bytes */
+	const uint8_t *nonce; /* nonce of the packet */
+	const uint8_t *associated_data; /* associated data */
+	unsigned int alen; /* associated data length in bytes */
+	const uint8_t *payload; /* payload, followed by the tag to open */
+	unsigned int plen; /* payload length in bytes, including the tag to open */
+	int status; /* OUT: TC_CRYPTO_SUCCESS (1) or TC_CRYPTO_FAIL (0) */
+} *TCCcmPacket_t;
+
+/**
+ * @brief Batch CCM tag generation and encryption procedure
+ * Seals the npackets packets of packets under the key and mac length of c,
+ * with the AES computations of up to 16 packets encrypted side by side;
+ * suits streams of short packets
+ * @return returns TC_CRYPTO_SUCCESS (1) if every packet was sealed
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                packets == NULL or
+ *                c == NULL or
+ *                a packet failed, as tc_ccm_generation_encryption would
+ *                on the same input, which its status tells
+ * @note The nonce of c is not used; out of a packet is either identical to
+ *       its payload or overlaps no buffer of the batch
+ * @param packets IN/OUT -- array of the packets to seal
+ * @param npackets IN -- number of packets
+ * @param c IN -- CCM state
+ */
+int tc_ccm_seal_batch(TCCcmPacket_t packets, unsigned int npackets,
+		      const TCCcmMode_t c);
+
+/**
+ * @brief Batch CCM decryption and tag verification procedure
+ * Opens the npackets packets of packets as tc_ccm_seal_batch seals them
+ * @return returns TC_CRYPTO_SUCCESS (1) if every packet was opened
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *                packets == NULL or
+ *                c == NULL or
+ *                a packet failed, as tc_ccm_decryption_verification would
+ *                on the same input, which its status tells
+ * @note The output of a packet whose tag is invalid is erased
+ * @param packets IN/OUT -- array of the packets to open
+ * @param npackets IN -- number of packets
+ * @param c IN -- CCM state
+ */
+int tc_ccm_open_batch(TCCcmPacket_t packets, unsigned int npackets,
+		      const TCCcmMode_t c);
+
 #ifdef __cplusplus
 }
 #endif
@@ -92,6 +92,11 @@
  *           Once you are done computing CMAC with a key, it is a good idea to
  *           destroy the state so an attacker cannot recover the key; use
  *           tc_cmac_erase to accomplish this.
+ *
+ *           To MAC many independent messages at once, possibly under
+ *           different keys, use tc_cmac_update_multi in step (2) and
+ *           tc_cmac_final_multi in step (3); they advance the states of all
+ *           the messages in lockstep and compute the same tags.
  */
 
 #ifndef __TC_CMAC_MODE_H__
@@ -142,6 +147,41 @@ typedef struct tc_cmac_struct {
 int tc_cmac_setup(TCCmacState_t s, const uint8_t *key,
 		      TCAesKeySched_t sched);
 
+/**
+ * @brief Derives the CMAC subkeys of an AES key
+ * @return returns TC_CRYPTO_SUCCESS (1) after having computed K1 and K2
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              K1 == NULL or
+ *              K2 == NULL or
+ *              sched == NULL
+ *
+ * @param K1 OUT -- subkey used when the last message block is complete
+ * @param K2 OUT -- subkey used when the last message block is padded
+ * @param sched IN -- AES encryption key schedule
+ */
+int tc_cmac_subkeys(uint8_t *K1, uint8_t *K2, const TCAesKeySched_t sched);
+
+/**
+ * @brief Configures the CMAC state to use an expanded key and its subkeys
+ * Same as tc_cmac_setup, for keys already expanded in sched and whose
+ * subkeys were derived by tc_cmac_subkeys, so that neither has to be
+ * computed again for every message
+ * @return returns TC_CRYPTO_SUCCESS (1) after having configured the CMAC state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL or
+ *              K1 == NULL or
+ *              K2 == NULL or
+ *              sched == NULL
+ *
+ * @param s IN/OUT -- the state to set up
+ * @param K1 IN -- first subkey of the key
+ * @param K2 IN -- second subkey of the key
+ * @param sched IN -- AES encryption key schedule, which must remain valid
+ *                    while s is used
+ */
+int tc_cmac_setup_subkeys(TCCmacState_t s, const uint8_t *K1,
+			  const uint8_t *K2, TCAesKeySched_t sched);
+
 /**
  * @brief Erases the CMAC state
  * @return returns TC_CRYPTO_SUCCESS (1) after having configured the CMAC state
@@ -187,6 +227,54 @@ int tc_cmac_update(TCCmacState_t s, const uint8_t *data, size_t dlen);
  */
 int tc_cmac_final(uint8_t *tag, TCCmacState_t s);
 
+/*
+ * One message of a multi-buffer CMAC batch: the len bytes of data are
+ * mixed into the CMAC state s
+ */
+typedef struct tc_cmac_job_struct {
+	TCCmacState_t s;
+	const uint8_t *data;
+	size_t len;
+} *TCCmacJob_t;
+
+/**
+ * @brief Multi-buffer CMAC update procedure
+ * Same as calling tc_cmac_update on each of the njobs messages of jobs, but
+ * the messages advance in lockstep, one block each per step, so that the
+ * blocks of a step are encrypted side by side through tc_aes_encrypt_jobs;
+ * CMAC being serial within a message, this keeps a multi-lane AES engine
+ * busy
+ * @return returns TC_CRYPTO_SUCCESS (1) after successfully updating the states
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              jobs == NULL or
+ *              the state of a message is NULL or
+ *              the data of a message is NULL when its len > 0 or
+ *              the state of a message has to be re-keyed
+ * @note The states of a batch must be distinct; on failure, none of them
+ *       has been updated, unless the AES engine itself failed
+ * @param jobs IN -- array of the messages to MAC
+ * @param njobs IN -- number of messages
+ */
+int tc_cmac_update_multi(const TCCmacJob_t jobs, unsigned int njobs);
+
+/**
+ * @brief Generates the tags of several CMAC states
+ * Same as calling tc_cmac_final on each of the nstates states, with the
+ * last blocks of all of them encrypted side by side
+ * @return returns TC_CRYPTO_SUCCESS (1) after successfully generating the tags
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              tags == NULL or
+ *              states == NULL or
+ *              one of the states is NULL
+ *
+ * @param tags OUT -- nstates * TC_AES_BLOCK_SIZE bytes receiving the CMAC
+ *                    tags, in the order of the states
+ * @param states IN -- the CMAC states, which are erased
+ * @param nstates IN -- number of states
+ */
+int tc_cmac_final_multi(uint8_t *tags, const TCCmacState_t *states,
+			unsigned int nstates);
+
 #ifdef __cplusplus
 }
 #endif
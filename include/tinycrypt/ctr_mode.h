@@ -62,6 +62,30 @@
  *
  *  Usage:     1) call tc_ctr_mode to process the data to encrypt/decrypt.
  *
+ *             2) call tc_ctr_mode_multi to process a batch of messages under
+ *             different keys at once.
+ *
+ *             3) to process a stream in chunks of any length, call
+ *             tc_ctr_init once, tc_ctr_update for each chunk and tc_ctr_final
+ *             at the end. The unused keystream of a partial block is kept
+ *             for the next chunk, and the counter may span 32, 64 or 128
+ *             bits of the counter block.
+ *
+ *             4) call tc_ctr_mode_at to process the bytes of a stream at a
+ *             given offset, without processing those before it, or
+ *             tc_ctr_seek to move a streaming state to an offset; regions
+ *             of a stream can so be processed independently, in any order.
+ *
+ *             5) to take the AES work off a latency sensitive path, set
+ *             up a keystream ring with tc_ctr_prefetch_init, fill it ahead
+ *             of time with tc_ctr_prefetch_fill, e.g. when idle, and
+ *             process the data with tc_ctr_prefetch_update, which only
+ *             XORs as long as enough keystream is buffered.
+ *
+ *             6) call tc_ctr_mode_mt to process a large buffer on several
+ *             threads; it is only available when TinyCrypt is built with
+ *             thread support.
+ *
  */
 
 #ifndef __TC_CTR_MODE_H__
@@ -69,6 +93,7 @@
 
 #include <tinycrypt/aes.h>
 #include <tinycrypt/constants.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -101,6 +126,265 @@ extern "C" {
 int tc_ctr_mode(uint8_t *out, unsigned int outlen, const uint8_t *in,
 		unsigned int inlen, uint8_t *ctr, const TCAesKeySched_t sched);
 
+/**
+ *  @brief Random-access CTR mode encryption/decryption procedure
+ *  Encrypts (or decrypts) the inlen bytes of the stream that starts with
+ *  counter block ctr and lie at byte offset offset, as tc_ctr_init,
+ *  tc_ctr_seek and tc_ctr_update would; ctr is left unchanged
+ *  @return returns TC_CRYPTO_SUCCESS (1)
+ *          returns TC_CRYPTO_FAIL (0) if:
+ *                out == NULL or
+ *                in == NULL or
+ *                ctr == NULL or
+ *                sched == NULL or
+ *                inlen == 0 or
+ *                outlen == 0 or
+ *                inlen != outlen or
+ *                width is not 32, 64 or 128
+ * @param out OUT -- produced ciphertext (plaintext)
+ * @param outlen IN -- length of ciphertext buffer in bytes
+ * @param in IN -- data to encrypt (or decrypt)
+ * @param inlen IN -- length of input data in bytes
+ * @param ctr IN -- the counter block at the start of the stream
+ * @param width IN -- width of the counter in bits
+ * @param offset IN -- offset in bytes of in from the start of the stream
+ * @param sched IN -- an initialized AES key schedule
+ */
+int tc_ctr_mode_at(uint8_t *out, unsigned int outlen, const uint8_t *in,
+		   unsigned int inlen, const uint8_t *ctr, unsigned int width,
+		   uint64_t offset, const TCAesKeySched_t sched);
+
+/* default number of bytes per chunk of tc_ctr_mode_mt */
+#define TC_CTR_MT_CHUNK (64 * 1024)
+
+/* default number of threads of tc_ctr_mode_mt */
+#define TC_CTR_MT_THREADS 4
+
+/**
+ *  @brief Multi-threaded CTR mode encryption/decryption procedure
+ *  Encrypts (or decrypts) as tc_ctr_mode, with the input split into chunks
+ *  of whole counter blocks processed by a pool of worker threads; the
+ *  output and the updated ctr are those of tc_ctr_mode
+ *  @return returns TC_CRYPTO_SUCCESS (1)
+ *          returns TC_CRYPTO_FAIL (0) if:
+ *                out == NULL or
+ *                in == NULL or
+ *                ctr == NULL or
+ *                sched == NULL or
+ *                inlen == 0 or
+ *                outlen == 0 or
+ *                inlen != outlen or
+ *                the worker threads could not be synchronized
+ * @note Assumes the same as tc_ctr_mode; sched may not be changed before the
+ *       call returns
+ * @param out OUT -- produced ciphertext (plaintext)
+ * @param outlen IN -- length of ciphertext buffer in bytes
+ * @param in IN -- data to encrypt (or decrypt)
+ * @param inlen IN -- length of input data in bytes
+ * @param ctr IN/OUT -- the current counter value
+ * @param sched IN -- an initialized AES key schedule
+ * @param chunk IN -- bytes per chunk, rounded down to whole blocks, or 0 for
+ *                    TC_CTR_MT_CHUNK
+ * @param nthreads IN -- number of threads, including the calling one, up to
+ *                       TC_PARALLEL_MAX_THREADS, or 0 for TC_CTR_MT_THREADS
+ */
+int tc_ctr_mode_mt(uint8_t *out, unsigned int outlen, const uint8_t *in,
+		   unsigned int inlen, uint8_t *ctr,
+		   const TCAesKeySched_t sched, unsigned int chunk,
+		   unsigned int nthreads);
+
+/*
+ * One message of a multi-key CTR batch, processed as by tc_ctr_mode: the
+ * len bytes of in are encrypted (or decrypted) into out under sched,
+ * starting from counter ctr, which is updated.
+ */
+typedef struct tc_ctr_job_struct {
+	uint8_t *out;
+	const uint8_t *in;
+	unsigned int len;
+	uint8_t *ctr;
+	TCAesKeySched_t sched;
+} *TCCtrJob_t;
+
+/**
+ *  @brief Multi-key CTR mode encryption/decryption procedure
+ *  Processes the njobs messages of jobs, each under its own key, with the
+ *  counter blocks of several messages encrypted side by side through
+ *  tc_aes_encrypt_jobs; suits batches of short packets from many peers
+ *  @return returns TC_CRYPTO_SUCCESS (1)
+ *          returns TC_CRYPTO_FAIL (0) if:
+ *                jobs == NULL or
+ *                the out, in, ctr or sched pointer of a message is NULL
+ *  @note Assumes the same as tc_ctr_mode for every message; messages of
+ *        zero length are left untouched, and out of a message is either
+ *        identical to its in or overlaps no buffer of the batch
+ *  @param jobs IN/OUT -- array of the messages to process
+ *  @param njobs IN -- number of messages
+ */
+int tc_ctr_mode_multi(const TCCtrJob_t jobs, unsigned int njobs);
+
+/* struct tc_ctr_struct represents the state of a streaming CTR computation */
+typedef struct tc_ctr_struct {
+/* counter block at the start of the stream */
+	uint8_t base[TC_AES_BLOCK_SIZE];
+/* next counter block to encrypt */
+	uint8_t ctr[TC_AES_BLOCK_SIZE];
+/* keystream of the last block, of which the final leftover bytes are unused */
+	uint8_t keystream[TC_AES_BLOCK_SIZE];
+/* number of unused keystream bytes */
+	unsigned int leftover;
+/* number of trailing counter block bytes that are incremented */
+	unsigned int width;
+/* AES key schedule */
+	TCAesKeySched_t sched;
+} *TCCtrState_t;
+
+/**
+ * @brief Initializes a streaming CTR computation
+ * @return returns TC_CRYPTO_SUCCESS (1) after having initialized the CTR state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL or
+ *              ctr == NULL or
+ *              sched == NULL or
+ *              width is not 32, 64 or 128
+ * @note The counter is the big-endian integer held by the last width bits
+ *       of the counter block; it wraps around within them, so no more than
+ *       2^width blocks may be processed with one initial value
+ * @param s OUT -- the state to initialize
+ * @param ctr IN -- the initial counter block, which must not have been used
+ *                  with sched
+ * @param width IN -- width of the counter in bits
+ * @param sched IN -- AES encryption key schedule, which must remain valid
+ *                    until tc_ctr_final
+ */
+int tc_ctr_init(TCCtrState_t s, const uint8_t *ctr, unsigned int width,
+		const TCAesKeySched_t sched);
+
+/**
+ * @brief Encrypts (or decrypts) the next chunk of the stream
+ * Chunks may have any length: the stream is processed as if it were given
+ * to tc_ctr_mode as a whole
+ * @return returns TC_CRYPTO_SUCCESS (1) after having processed the chunk
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL or
+ *              out == NULL or in == NULL when len > 0
+ * @note out and in may be the same buffer, to process the chunk in place
+ * @param s IN/OUT -- the CTR state
+ * @param out OUT -- produced ciphertext (plaintext)
+ * @param in IN -- data to encrypt (or decrypt)
+ * @param len IN -- length of the chunk in bytes
+ */
+int tc_ctr_update(TCCtrState_t s, uint8_t *out, const uint8_t *in,
+		  size_t len);
+
+/**
+ * @brief Moves a streaming CTR computation to a byte offset in the stream
+ * The next tc_ctr_update processes the stream from that offset on, the
+ * counter carry being propagated across the counter width
+ * @return returns TC_CRYPTO_SUCCESS (1) after having moved the CTR state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL
+ * @param s IN/OUT -- the CTR state
+ * @param offset IN -- offset in bytes from the start of the stream
+ */
+int tc_ctr_seek(TCCtrState_t s, uint64_t offset);
+
+/**
+ * @brief Ends a streaming CTR computation and erases the CTR state
+ * @return returns TC_CRYPTO_SUCCESS (1) after having erased the CTR state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              s == NULL
+ * @param ctr OUT -- if not NULL, receives the first counter block not used
+ *                   by the stream, from which a later stream may continue
+ * @param s IN/OUT -- the CTR state
+ */
+int tc_ctr_final(uint8_t *ctr, TCCtrState_t s);
+
+/*
+ * struct tc_ctr_prefetch_struct represents a streaming CTR computation with
+ * a ring of keystream generated ahead of time
+ */
+typedef struct tc_ctr_prefetch_struct {
+/* stream state, at the first block not generated into the ring */
+	struct tc_ctr_struct ctr;
+/* keystream ring */
+	uint8_t *ring;
+/* size of the ring in bytes, a multiple of the block size */
+	unsigned int size;
+/* offset in the ring of the next unused keystream byte */
+	unsigned int head;
+/* number of unused keystream bytes in the ring */
+	unsigned int fill;
+} *TCCtrPrefetch_t;
+
+/**
+ * @brief Initializes a streaming CTR computation with a keystream ring
+ * @return returns TC_CRYPTO_SUCCESS (1) after having initialized the state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              p == NULL or
+ *              ring == NULL or
+ *              size < TC_AES_BLOCK_SIZE or
+ *              tc_ctr_init fails on ctr, width and sched
+ * @note The ring starts empty; the calls on p must not overlap, so that a
+ *       background thread filling the ring must share a lock with the
+ *       thread processing the data
+ * @param p OUT -- the state to initialize
+ * @param ring IN -- buffer for the keystream, which must remain valid until
+ *                   tc_ctr_prefetch_final
+ * @param size IN -- size of ring in bytes, rounded down to whole blocks
+ * @param ctr IN -- as for tc_ctr_init
+ * @param width IN -- as for tc_ctr_init
+ * @param sched IN -- as for tc_ctr_init
+ */
+int tc_ctr_prefetch_init(TCCtrPrefetch_t p, uint8_t *ring, unsigned int size,
+			 const uint8_t *ctr, unsigned int width,
+			 const TCAesKeySched_t sched);
+
+/**
+ * @brief Generates keystream ahead of time into the ring
+ * Generates up to max bytes, rounded up to whole blocks, or as much as
+ * the ring has room for; calling it with a small max bounds its latency
+ * @return returns TC_CRYPTO_SUCCESS (1) after having generated the keystream
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              p == NULL
+ * @param p IN/OUT -- the state
+ * @param max IN -- maximum number of bytes to generate
+ */
+int tc_ctr_prefetch_fill(TCCtrPrefetch_t p, unsigned int max);
+
+/**
+ * @brief Reports how much keystream is buffered
+ * @return returns the number of bytes tc_ctr_prefetch_update can process
+ *         without generating keystream, or 0 if p == NULL
+ * @param p IN -- the state
+ */
+unsigned int tc_ctr_prefetch_buffered(const TCCtrPrefetch_t p);
+
+/**
+ * @brief Encrypts (or decrypts) the next chunk of the stream
+ * Uses the buffered keystream first, then falls back to generating the rest
+ * inline as tc_ctr_update does
+ * @return returns TC_CRYPTO_SUCCESS (1) after having processed the chunk
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              p == NULL or
+ *              out == NULL or in == NULL when len > 0
+ * @param p IN/OUT -- the state
+ * @param out OUT -- produced ciphertext (plaintext)
+ * @param in IN -- data to encrypt (or decrypt), which may be out
+ * @param len IN -- length of the chunk in bytes
+ */
+int tc_ctr_prefetch_update(TCCtrPrefetch_t p, uint8_t *out,
+			   const uint8_t *in, size_t len);
+
+/**
+ * @brief Erases the state and the keystream ring
+ * @return returns TC_CRYPTO_SUCCESS (1) after having erased the state
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              p == NULL
+ * @param p IN/OUT -- the state
+ */
+int tc_ctr_prefetch_final(TCCtrPrefetch_t p);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,187 @@
+/* keyring.h - TinyCrypt interface to a keyring of expanded AES keys */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @brief Interface to a keyring of expanded AES keys.
+ *
+ *  Overview:  The keyring caches, under a caller chosen key ID, the AES
+ *             encryption schedule of a key, its CMAC subkeys and optionally
+ *             its decryption schedule, so that services using the same keys
+ *             over and over expand them once. The schedules it hands out are
+ *             used directly by the modes (tc_ctr_mode, tc_ccm_config,
+ *             tc_cbc_mode_encrypt/decrypt, tc_cmac_setup_subkeys).
+ *
+ *             The keyring is an array of entries supplied by the caller,
+ *             organized as a set-associative cache: a key ID hashes to a set
+ *             of TC_KEYRING_WAYS consecutive entries, and adding a key to a
+ *             full set evicts its least recently looked up entry that is not
+ *             in use. Evicted and removed entries are securely zeroed.
+ *
+ *  Security:  The entries hold expanded keys; their memory deserves the same
+ *             protection as the keys themselves.
+ *
+ *  Requires:  AES, CMAC
+ *
+ *  Usage:     1) call tc_keyring_init with storage for a power of two number
+ *             of entries.
+ *
+ *             2) call tc_keyring_add to expand and cache a key. Calls adding
+ *             and removing keys must not run concurrently with each other.
+ *
+ *             3) call tc_keyring_get to look a key up, use the schedules of
+ *             the entry returned, then release it with tc_keyring_put.
+ *             Lookups take no lock and may run concurrently with each other
+ *             and with additions and removals; an entry is never evicted or
+ *             removed while a lookup holds it.
+ */
+
+#ifndef __TC_KEYRING_H__
+#define __TC_KEYRING_H__
+
+#include <tinycrypt/aes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* number of entries a key ID may be stored in */
+#define TC_KEYRING_WAYS (8)
+
+/* tc_keyring_add flag asking for a decryption schedule as well */
+#define TC_KEYRING_DECRYPT (1)
+
+typedef struct tc_keyring_entry {
+/* key ID, 0 while the entry is free */
+	unsigned int id;
+/* lookups holding the entry, plus a flag while it is being rewritten */
+	unsigned int refs;
+/* keyring clock at the last lookup or addition, for the eviction */
+	unsigned int last;
+/* flags given to tc_keyring_add */
+	unsigned int flags;
+/* AES encryption key schedule */
+	struct tc_aes_key_sched_struct enc;
+/* AES decryption key schedule, if flags has TC_KEYRING_DECRYPT */
+	struct tc_aes_key_sched_struct dec;
+/* CMAC subkeys */
+	uint8_t K1[TC_AES_BLOCK_SIZE];
+	uint8_t K2[TC_AES_BLOCK_SIZE];
+} *TCKeyringEntry_t;
+
+typedef struct tc_keyring_struct {
+/* caller supplied entries */
+	TCKeyringEntry_t entries;
+/* number of entries minus one */
+	unsigned int mask;
+/* advanced by every addition, lookups stamp the entries with it */
+	unsigned int clock;
+} *TCKeyring_t;
+
+/**
+ * @brief Initializes an empty keyring
+ * @return returns TC_CRYPTO_SUCCESS (1)
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              r == NULL or
+ *              entries == NULL or
+ *              nentries is not a power of two
+ *
+ * @param r IN/OUT -- the keyring to initialize
+ * @param entries IN -- storage for the entries
+ * @param nentries IN -- number of entries, a power of two
+ */
+int tc_keyring_init(TCKeyring_t r, TCKeyringEntry_t entries,
+		    unsigned int nentries);
+
+/**
+ * @brief Expands a key and caches it under a key ID
+ * Replaces the key already cached under id, if any
+ * @return returns TC_CRYPTO_SUCCESS (1)
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              r == NULL or
+ *              key == NULL or
+ *              id == 0 or
+ *              keylen is not TC_AES_KEY_SIZE, TC_AES192_KEY_SIZE or
+ *              TC_AES256_KEY_SIZE or
+ *              keylen needs more than TC_AES_MAX_ROUNDS rounds or
+ *              the entry already holding id, or every entry of its set,
+ *              is held by a lookup or
+ *              lookups racing with the addition took hold of the entry
+ *              chosen for id twice in a row
+ * @note Must not run concurrently with another addition or a removal
+ *
+ * @param r IN/OUT -- the keyring
+ * @param id IN -- non-zero key ID
+ * @param key IN -- the AES key
+ * @param keylen IN -- length of key in bytes
+ * @param flags IN -- 0 or TC_KEYRING_DECRYPT
+ */
+int tc_keyring_add(TCKeyring_t r, unsigned int id, const uint8_t *key,
+		   unsigned int keylen, unsigned int flags);
+
+/**
+ * @brief Removes a key from the keyring and zeroes its entry
+ * @return returns TC_CRYPTO_SUCCESS (1)
+ *         returns TC_CRYPTO_FAIL (0) if:
+ *              r == NULL or
+ *              id is not in the keyring or
+ *              its entry is held by a lookup
+ *
+ * @param r IN/OUT -- the keyring
+ * @param id IN -- key ID
+ */
+int tc_keyring_remove(TCKeyring_t r, unsigned int id);
+
+/**
+ * @brief Looks a key up
+ * @return returns the entry of the key, to be released by tc_keyring_put
+ *         returns NULL if:
+ *              r == NULL or
+ *              id is not in the keyring
+ *
+ * @param r IN/OUT -- the keyring
+ * @param id IN -- key ID
+ */
+TCKeyringEntry_t tc_keyring_get(TCKeyring_t r, unsigned int id);
+
+/**
+ * @brief Releases an entry returned by tc_keyring_get
+ *
+ * @param e IN/OUT -- the entry
+ */
+void tc_keyring_put(TCKeyringEntry_t e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TC_KEYRING_H__ */
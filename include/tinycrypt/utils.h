@@ -95,6 +95,37 @@ static inline void _set_secure(void *to, uint8_t val, unsigned int len)
 }
 #endif /* TINYCRYPT_ARCH_HAS_SET_SECURE */
 
+/**
+ * @brief XOR the buffers 'a' and 'b' into 'out', a machine word at a time.
+ *
+ * @param out OUT -- destination buffer, which may be 'a' or 'b'
+ * @param a IN -- first operand
+ * @param b IN -- second operand
+ * @param len IN -- length of the buffers
+ */
+void _xor(uint8_t *out, const uint8_t *a, const uint8_t *b,
+	  unsigned int len);
+
+/* maximum number of threads of a _parallel call */
+#define TC_PARALLEL_MAX_THREADS 16
+
+/**
+ * @brief Run the tasks 0 to 'ntasks' - 1 on up to 'nthreads' threads,
+ *        including the calling one, and wait for all of them to complete.
+ *        Only available when TinyCrypt is built with thread support.
+ * @return returns TC_CRYPTO_SUCCESS (1) if all the tasks succeeded
+ *         returns TC_CRYPTO_FAIL (0) if a task failed, after which the
+ *                tasks not yet started are skipped
+ *
+ * @param task IN -- function running task 'i' on 'arg', returning
+ *                   TC_CRYPTO_SUCCESS or TC_CRYPTO_FAIL
+ * @param arg IN -- argument passed to every task
+ * @param ntasks IN -- number of tasks
+ * @param nthreads IN -- number of threads, at most TC_PARALLEL_MAX_THREADS
+ */
+int _parallel(int (*task)(void *arg, unsigned int i), void *arg,
+	      unsigned int ntasks, unsigned int nthreads);
+
 /*
  * @brief AES specific doubling function, which utilizes
  * the finite field used by AES.
@@ -33,6 +33,7 @@
 #include <tinycrypt/aes.h>
 #include <tinycrypt/constants.h>
 #include <tinycrypt/utils.h>
+#include "aes_internal.h"
 
 static const uint8_t inv_sbox[256] = {
 	0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e,
@@ -59,78 +60,419 @@ static const uint8_t inv_sbox[256] = {
 	0x55, 0x21, 0x0c, 0x7d
 };
 
+static inline unsigned int rotword(unsigned int a)
+{
+	return (((a) >> 24)|((a) << 8));
+}
+
+#define inv_subbyte(a, o)((unsigned int) inv_sbox[((a) >> (o))&0xff] << (o))
+
+/* see aes_encrypt.c for the column layout of the state */
+static inline unsigned int load_column(const uint8_t *p)
+{
+	return ((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) |
+	       ((unsigned int) p[2] << 8) | ((unsigned int) p[3]);
+}
+
+static inline void store_column(uint8_t *p, unsigned int c)
+{
+	p[0] = (uint8_t)(c >> 24); p[1] = (uint8_t)(c >> 16);
+	p[2] = (uint8_t)(c >> 8); p[3] = (uint8_t)(c);
+}
+
+/* doubles the four bytes of a column at once */
+#define xtime_column(a)((((a) & 0x7f7f7f7f) << 1) ^ \
+			 ((((a) >> 7) & 0x01010101) * 0x1b))
+
+/*
+ * InvMixColumns on one column, computed as MixColumns applied to a column
+ * preprocessed with two extra doublings, since
+ * {0e,0b,0d,09} = {02,03,01,01} x {05,00,04,00}.
+ */
+static inline unsigned int inv_mix_column(unsigned int a)
+{
+	unsigned int r1, r2;
+
+	r2 = (a << 16) | (a >> 16);
+	a ^= xtime_column(xtime_column(a ^ r2));
+
+	r1 = rotword(a);
+	r2 = rotword(r1);
+	return xtime_column(a ^ r1) ^ r1 ^ r2 ^ rotword(r2);
+}
+
+static inline void inv_mix_columns(unsigned int *s)
+{
+	s[0] = inv_mix_column(s[0]);
+	s[1] = inv_mix_column(s[1]);
+	s[2] = inv_mix_column(s[2]);
+	s[3] = inv_mix_column(s[3]);
+}
+
+/*
+ * The decryption schedule follows the equivalent inverse cipher of FIPS-197
+ * Figure 15: the encryption round keys with InvMixColumns applied to all but
+ * the first and the last, which lets tc_aes_decrypt apply the round
+ * transformations in the same order as encryption.
+ */
+static void invert_schedule(TCAesKeySched_t s)
+{
+	unsigned int i;
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_invert_schedule(s);
+		return;
+	}
+#endif
+
+	for (i = Nb; i < (Nb * s->rounds); ++i) {
+		s->words[i] = inv_mix_column(s->words[i]);
+	}
+}
+
 int tc_aes128_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
 {
-	return tc_aes128_set_encrypt_key(s, k);
+	if (tc_aes128_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes192_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	if (tc_aes192_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
 }
 
-#define mult8(a)(_double_byte(_double_byte(_double_byte(a))))
-#define mult9(a)(mult8(a)^(a))
-#define multb(a)(mult8(a)^_double_byte(a)^(a))
-#define multd(a)(mult8(a)^_double_byte(_double_byte(a))^(a))
-#define multe(a)(mult8(a)^_double_byte(_double_byte(a))^_double_byte(a))
+int tc_aes256_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	if (tc_aes256_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
 
-static inline void mult_row_column(uint8_t *out, const uint8_t *in)
+/*
+ * The decryption schedule of a key pair is derived from its encryption
+ * schedule, so that the key is expanded only once.
+ */
+static int set_key_pair(TCAesKeyPair_t p, const uint8_t *k,
+			int (*set_encrypt_key)(TCAesKeySched_t, const uint8_t *))
 {
-	out[0] = multe(in[0]) ^ multb(in[1]) ^ multd(in[2]) ^ mult9(in[3]);
-	out[1] = mult9(in[0]) ^ multe(in[1]) ^ multb(in[2]) ^ multd(in[3]);
-	out[2] = multd(in[0]) ^ mult9(in[1]) ^ multe(in[2]) ^ multb(in[3]);
-	out[3] = multb(in[0]) ^ multd(in[1]) ^ mult9(in[2]) ^ multe(in[3]);
+	if (p == (TCAesKeyPair_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (set_encrypt_key(&p->enc, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	p->dec = p->enc;
+	invert_schedule(&p->dec);
+
+	return TC_CRYPTO_SUCCESS;
 }
 
-static inline void inv_mix_columns(uint8_t *s)
+int tc_aes128_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
 {
-	uint8_t t[Nb*Nk];
+	return set_key_pair(p, k, tc_aes128_set_encrypt_key);
+}
 
-	mult_row_column(t, s);
-	mult_row_column(&t[Nb], s+Nb);
-	mult_row_column(&t[2*Nb], s+(2*Nb));
-	mult_row_column(&t[3*Nb], s+(3*Nb));
-	(void)_copy(s, sizeof(t), t, sizeof(t));
+int tc_aes192_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+	return set_key_pair(p, k, tc_aes192_set_encrypt_key);
 }
 
-static inline void add_round_key(uint8_t *s, const unsigned int *k)
+int tc_aes256_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
 {
-	s[0] ^= (uint8_t)(k[0] >> 24); s[1] ^= (uint8_t)(k[0] >> 16);
-	s[2] ^= (uint8_t)(k[0] >> 8); s[3] ^= (uint8_t)(k[0]);
-	s[4] ^= (uint8_t)(k[1] >> 24); s[5] ^= (uint8_t)(k[1] >> 16);
-	s[6] ^= (uint8_t)(k[1] >> 8); s[7] ^= (uint8_t)(k[1]);
-	s[8] ^= (uint8_t)(k[2] >> 24); s[9] ^= (uint8_t)(k[2] >> 16);
-	s[10] ^= (uint8_t)(k[2] >> 8); s[11] ^= (uint8_t)(k[2]);
-	s[12] ^= (uint8_t)(k[3] >> 24); s[13] ^= (uint8_t)(k[3] >> 16);
-	s[14] ^= (uint8_t)(k[3] >> 8); s[15] ^= (uint8_t)(k[3]);
+	return set_key_pair(p, k, tc_aes256_set_encrypt_key);
 }
 
-static inline void inv_sub_bytes(uint8_t *s)
+/*
+ * Batch key setup: this engine has no parallel key expansion, so the keys
+ * are set one at a time, and their decryption schedules derived from the
+ * encryption ones.
+ */
+static int set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		    const uint8_t *k, unsigned int n, unsigned int keylen,
+		    int (*set_encrypt_key)(TCAesKeySched_t, const uint8_t *))
 {
 	unsigned int i;
 
-	for (i = 0; i < (Nb*Nk); ++i) {
-		s[i] = inv_sbox[s[i]];
+	if (enc == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (k == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (set_encrypt_key(&enc[i], k + keylen * i) !=
+		    TC_CRYPTO_SUCCESS) {
+			return TC_CRYPTO_FAIL;
+		}
+	}
+
+	if (dec != (TCAesKeySched_t) 0) {
+		for (i = 0; i < n; ++i) {
+			dec[i] = enc[i];
+			invert_schedule(&dec[i]);
+		}
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes128_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, TC_AES_KEY_SIZE,
+			tc_aes128_set_encrypt_key);
+}
+
+int tc_aes192_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, TC_AES192_KEY_SIZE,
+			tc_aes192_set_encrypt_key);
+}
+
+int tc_aes256_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, TC_AES256_KEY_SIZE,
+			tc_aes256_set_encrypt_key);
+}
+
+/*
+ * Runs the key expansion of an on-the-fly key forwards to its end, leaving
+ * the last nk words of the schedule, word i in words[i % nk], from which
+ * decryption expands the round keys backwards.
+ */
+static void invert_otf_key(TCAesOtfKey_t o)
+{
+	unsigned int nk = (o->rounds & ~TC_AES_OTF) - 6;
+	unsigned int i, p;
+
+	for (i = nk, p = 0; i < Nb * (nk + 7); ++i) {
+		o->words[p] ^= _tc_aes_expand_word(
+			o->words[p == 0 ? nk - 1 : p - 1], p, i, nk);
+		p = (p + 1 == nk) ? 0 : p + 1;
+	}
+}
+
+int tc_aes128_set_decrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k)
+{
+	if (tc_aes128_set_encrypt_key_otf(o, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_otf_key(o);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes192_set_decrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k)
+{
+	if (tc_aes192_set_encrypt_key_otf(o, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
 	}
+
+	invert_otf_key(o);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes256_set_decrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k)
+{
+	if (tc_aes256_set_encrypt_key_otf(o, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_otf_key(o);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+static inline void add_round_key(unsigned int *s, const unsigned int *k)
+{
+	s[0] ^= k[0]; s[1] ^= k[1]; s[2] ^= k[2]; s[3] ^= k[3];
+}
+
+/*
+ * InvSubBytes and InvShiftRows in one pass: row r of output column c is the
+ * substituted row r of input column c - r.
+ */
+static inline void inv_sub_shift_rows(unsigned int *s)
+{
+	unsigned int t[Nb];
+
+	t[0] = inv_subbyte(s[0], 24) | inv_subbyte(s[3], 16) |
+	       inv_subbyte(s[2], 8) | inv_subbyte(s[1], 0);
+	t[1] = inv_subbyte(s[1], 24) | inv_subbyte(s[0], 16) |
+	       inv_subbyte(s[3], 8) | inv_subbyte(s[2], 0);
+	t[2] = inv_subbyte(s[2], 24) | inv_subbyte(s[1], 16) |
+	       inv_subbyte(s[0], 8) | inv_subbyte(s[3], 0);
+	t[3] = inv_subbyte(s[3], 24) | inv_subbyte(s[2], 16) |
+	       inv_subbyte(s[1], 8) | inv_subbyte(s[0], 0);
+	s[0] = t[0]; s[1] = t[1]; s[2] = t[2]; s[3] = t[3];
+}
+
+static inline void decrypt_round(unsigned int *state, const unsigned int *k)
+{
+	inv_sub_shift_rows(state);
+	inv_mix_columns(state);
+	add_round_key(state, k);
+}
+
+static void decrypt_block(uint8_t *out, const uint8_t *in,
+			  const TCAesKeySched_t s)
+{
+	const unsigned int *rk;
+	unsigned int state[Nb];
+	unsigned int nr = _tc_aes_rounds(s);
+
+	rk = s->words + Nb * nr;
+
+	state[0] = load_column(in);
+	state[1] = load_column(in + 4);
+	state[2] = load_column(in + 8);
+	state[3] = load_column(in + 12);
+	add_round_key(state, rk);
+
+	/* fully unrolled, the extra rounds falling through as in encryption */
+	switch (nr) {
+	case 14:
+		decrypt_round(state, rk - Nb);
+		decrypt_round(state, rk - 2 * Nb);
+		rk -= 2 * Nb;
+		/* fall through */
+	case 12:
+		decrypt_round(state, rk - Nb);
+		decrypt_round(state, rk - 2 * Nb);
+		rk -= 2 * Nb;
+		/* fall through */
+	default:
+		decrypt_round(state, rk - Nb);
+		decrypt_round(state, rk - 2 * Nb);
+		decrypt_round(state, rk - 3 * Nb);
+		decrypt_round(state, rk - 4 * Nb);
+		decrypt_round(state, rk - 5 * Nb);
+		decrypt_round(state, rk - 6 * Nb);
+		decrypt_round(state, rk - 7 * Nb);
+		decrypt_round(state, rk - 8 * Nb);
+		decrypt_round(state, rk - 9 * Nb);
+	}
+
+	inv_sub_shift_rows(state);
+	add_round_key(state, rk - 10 * Nb);
+
+	store_column(out, state[0]);
+	store_column(out + 4, state[1]);
+	store_column(out + 8, state[2]);
+	store_column(out + 12, state[3]);
+
+	/*zeroing out the state buffer */
+	_set(state, TC_ZERO_BYTE, sizeof(state));
 }
 
 /*
- * This inv_shift_rows also implements the matrix flip required for
- * inv_mix_columns, but performs it here to reduce the number of memory
- * operations.
+ * Decryption under an on-the-fly key, using the straightforward inverse
+ * cipher since the round keys come out of the expansion unmixed. Walking
+ * backwards, word i + nk in w[i % nk] is overwritten with word i, which
+ * yields the round keys from the last to the first.
  */
-static inline void inv_shift_rows(uint8_t *s)
+static void decrypt_block_otf(uint8_t *out, const uint8_t *in,
+			      const TCAesKeySched_t s)
 {
-	uint8_t t[Nb*Nk];
+	const struct tc_aes_otf_key_struct *o = (const void *) s;
+	unsigned int w[TC_AES256_KEY_SIZE/Nb];
+	unsigned int state[Nb];
+	unsigned int nr = o->rounds & ~TC_AES_OTF;
+	unsigned int nk, top, i, p, r, c;
 
-	t[0]  = s[0]; t[1] = s[13]; t[2] = s[10]; t[3] = s[7];
-	t[4]  = s[4]; t[5] = s[1]; t[6] = s[14]; t[7] = s[11];
-	t[8]  = s[8]; t[9] = s[5]; t[10] = s[2]; t[11] = s[15];
-	t[12] = s[12]; t[13] = s[9]; t[14] = s[6]; t[15] = s[3];
-	(void)_copy(s, sizeof(t), t, sizeof(t));
+	if (nr != 12 && nr != 14) {
+		nr = Nr;
+	}
+	nk = nr - 6;
+	for (i = 0; i < nk; ++i) {
+		w[i] = o->words[i];
+	}
+
+	state[0] = load_column(in);
+	state[1] = load_column(in + 4);
+	state[2] = load_column(in + 8);
+	state[3] = load_column(in + 12);
+
+	top = Nb * (nr + 1);
+	i = top;
+	p = (top - 1) % nk;
+	for (r = nr + 1; r-- > 0;) {
+		if (r < nr) {
+			inv_sub_shift_rows(state);
+		}
+		for (c = Nb; c-- > 0;) {
+			if (--i < top - nk) {
+				w[p] ^= _tc_aes_expand_word(
+					w[p == 0 ? nk - 1 : p - 1], p, i + nk, nk);
+			}
+			state[c] ^= w[p];
+			p = (p == 0) ? nk - 1 : p - 1;
+		}
+		if (r > 0 && r < nr) {
+			inv_mix_columns(state);
+		}
+	}
+
+	store_column(out, state[0]);
+	store_column(out + 4, state[1]);
+	store_column(out + 8, state[2]);
+	store_column(out + 12, state[3]);
+
+	/* zeroing out the state and key buffers */
+	_set(state, TC_ZERO_BYTE, sizeof(state));
+	_set(w, TC_ZERO_BYTE, sizeof(w));
 }
 
 int tc_aes_decrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
 {
-	uint8_t state[Nk*Nb];
-	unsigned int i;
+	if (out == (uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (in == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (s == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	if (s->rounds & TC_AES_OTF) {
+		decrypt_block_otf(out, in, s);
+		return TC_CRYPTO_SUCCESS;
+	}
 
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_decrypt(out, in, s);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	decrypt_block(out, in, s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_decrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s)
+{
 	if (out == (uint8_t *) 0) {
 		return TC_CRYPTO_FAIL;
 	} else if (in == (const uint8_t *) 0) {
@@ -139,26 +481,70 @@ int tc_aes_decrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
 		return TC_CRYPTO_FAIL;
 	}
 
-	(void)_copy(state, sizeof(state), in, sizeof(state));
+	if (s->rounds & TC_AES_OTF) {
+		for (; nblocks > 0; --nblocks) {
+			decrypt_block_otf(out, in, s);
+			in += TC_AES_BLOCK_SIZE;
+			out += TC_AES_BLOCK_SIZE;
+		}
+		return TC_CRYPTO_SUCCESS;
+	}
 
-	add_round_key(state, s->words + Nb*Nr);
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_decrypt_blocks(out, in, nblocks, s);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
 
-	for (i = Nr - 1; i > 0; --i) {
-		inv_shift_rows(state);
-		inv_sub_bytes(state);
-		add_round_key(state, s->words + Nb*i);
-		inv_mix_columns(state);
+	for (; nblocks > 0; --nblocks) {
+		decrypt_block(out, in, s);
+		in += TC_AES_BLOCK_SIZE;
+		out += TC_AES_BLOCK_SIZE;
 	}
 
-	inv_shift_rows(state);
-	inv_sub_bytes(state);
-	add_round_key(state, s->words);
+	return TC_CRYPTO_SUCCESS;
+}
 
-	(void)_copy(out, sizeof(state), state, sizeof(state));
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+/* on-the-fly keys keep a multi-key batch off the AES-NI routines */
+static int has_otf_key(const TCAesJob_t jobs, unsigned int njobs)
+{
+	unsigned int j;
 
-	/*zeroing out the state buffer */
-	_set(state, TC_ZERO_BYTE, sizeof(state));
+	for (j = 0; j < njobs; ++j) {
+		if (jobs[j].sched->rounds & TC_AES_OTF) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * The byte-oriented engine has no parallel lanes to fill, so it runs the
+ * entries of a multi-key batch one after the other.
+ */
+int tc_aes_decrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	unsigned int j;
 
+	if (_tc_aes_check_jobs(jobs, njobs) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available() && !has_otf_key(jobs, njobs)) {
+		_tc_aesni_decrypt_jobs(jobs, njobs);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	for (j = 0; j < njobs; ++j) {
+		(void)tc_aes_decrypt_blocks(jobs[j].out, jobs[j].in,
+					jobs[j].nblocks, jobs[j].sched);
+	}
 
 	return TC_CRYPTO_SUCCESS;
 }
@@ -33,6 +33,7 @@
 #include <tinycrypt/aes.h>
 #include <tinycrypt/utils.h>
 #include <tinycrypt/constants.h>
+#include "aes_internal.h"
 
 static const uint8_t sbox[256] = {
 	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b,
@@ -64,102 +65,333 @@ static inline unsigned int rotword(unsigned int a)
 	return (((a) >> 24)|((a) << 8));
 }
 
-#define subbyte(a, o)(sbox[((a) >> (o))&0xff] << (o))
+#define subbyte(a, o)((unsigned int) sbox[((a) >> (o))&0xff] << (o))
 #define subword(a)(subbyte(a, 24)|subbyte(a, 16)|subbyte(a, 8)|subbyte(a, 0))
 
-int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+/*
+ * The state is kept as four 32-bit columns, laid out like the key schedule
+ * words: row 0 of a column is its most significant byte.
+ */
+static inline unsigned int load_column(const uint8_t *p)
+{
+	return ((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) |
+	       ((unsigned int) p[2] << 8) | ((unsigned int) p[3]);
+}
+
+static inline void store_column(uint8_t *p, unsigned int c)
+{
+	p[0] = (uint8_t)(c >> 24); p[1] = (uint8_t)(c >> 16);
+	p[2] = (uint8_t)(c >> 8); p[3] = (uint8_t)(c);
+}
+
+static const unsigned int rconst[11] = {
+	0x00000000, 0x01000000, 0x02000000, 0x04000000, 0x08000000, 0x10000000,
+	0x20000000, 0x40000000, 0x80000000, 0x1b000000, 0x36000000
+};
+
+/*
+ * FIPS-197 key expansion step for word i of a key of nk words, with t the
+ * previous word and p equal to i % nk; 256-bit keys take an extra SubWord
+ * in the middle of every nk words.
+ */
+static inline unsigned int expand_word(unsigned int t, unsigned int p,
+				       unsigned int i, unsigned int nk)
+{
+	if (p == 0) {
+		return subword(rotword(t)) ^ rconst[i/nk];
+	} else if (nk > 6 && p == 4) {
+		return subword(t);
+	}
+	return t;
+}
+
+unsigned int _tc_aes_expand_word(unsigned int t, unsigned int p,
+				 unsigned int i, unsigned int nk)
+{
+	return expand_word(t, p, i, nk);
+}
+
+/* key expansion for a key of nk words, processed in nk + 6 rounds */
+static int set_encrypt_key(TCAesKeySched_t s, const uint8_t *k,
+			   unsigned int nk)
 {
-	const unsigned int rconst[11] = {
-		0x00000000, 0x01000000, 0x02000000, 0x04000000, 0x08000000, 0x10000000,
-		0x20000000, 0x40000000, 0x80000000, 0x1b000000, 0x36000000
-	};
 	unsigned int i;
-	unsigned int t;
 
 	if (s == (TCAesKeySched_t) 0) {
 		return TC_CRYPTO_FAIL;
 	} else if (k == (const uint8_t *) 0) {
 		return TC_CRYPTO_FAIL;
+	} else if (nk + 6 > TC_AES_MAX_ROUNDS) {
+		return TC_CRYPTO_FAIL;
 	}
 
-	for (i = 0; i < Nk; ++i) {
-		s->words[i] = (k[Nb*i]<<24) | (k[Nb*i+1]<<16) |
-			      (k[Nb*i+2]<<8) | (k[Nb*i+3]);
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_set_encrypt_key(s, k, nk);
+		return TC_CRYPTO_SUCCESS;
 	}
+#endif
 
-	for (; i < (Nb * (Nr + 1)); ++i) {
-		t = s->words[i-1];
-		if ((i % Nk) == 0) {
-			t = subword(rotword(t)) ^ rconst[i/Nk];
-		}
-		s->words[i] = s->words[i-Nk] ^ t;
+	s->rounds = nk + 6;
+	for (i = 0; i < nk; ++i) {
+		s->words[i] = load_column(k + Nb*i);
+	}
+
+	for (; i < (Nb * (s->rounds + 1)); ++i) {
+		s->words[i] = s->words[i-nk] ^
+			      expand_word(s->words[i-1], i % nk, i, nk);
 	}
 
 	return TC_CRYPTO_SUCCESS;
 }
 
-static inline void add_round_key(uint8_t *s, const unsigned int *k)
+int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	return set_encrypt_key(s, k, Nk);
+}
+
+int tc_aes192_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	return set_encrypt_key(s, k, TC_AES192_KEY_SIZE / Nb);
+}
+
+int tc_aes256_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
 {
-	s[0] ^= (uint8_t)(k[0] >> 24); s[1] ^= (uint8_t)(k[0] >> 16);
-	s[2] ^= (uint8_t)(k[0] >> 8); s[3] ^= (uint8_t)(k[0]);
-	s[4] ^= (uint8_t)(k[1] >> 24); s[5] ^= (uint8_t)(k[1] >> 16);
-	s[6] ^= (uint8_t)(k[1] >> 8); s[7] ^= (uint8_t)(k[1]);
-	s[8] ^= (uint8_t)(k[2] >> 24); s[9] ^= (uint8_t)(k[2] >> 16);
-	s[10] ^= (uint8_t)(k[2] >> 8); s[11] ^= (uint8_t)(k[2]);
-	s[12] ^= (uint8_t)(k[3] >> 24); s[13] ^= (uint8_t)(k[3] >> 16);
-	s[14] ^= (uint8_t)(k[3] >> 8); s[15] ^= (uint8_t)(k[3]);
+	return set_encrypt_key(s, k, TC_AES256_KEY_SIZE / Nb);
 }
 
-static inline void sub_bytes(uint8_t *s)
+static int set_encrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k,
+			       unsigned int nk)
 {
 	unsigned int i;
 
-	for (i = 0; i < (Nb * Nk); ++i) {
-		s[i] = sbox[s[i]];
+	if (o == (TCAesOtfKey_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (k == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	o->rounds = (nk + 6) | TC_AES_OTF;
+	for (i = 0; i < nk; ++i) {
+		o->words[i] = load_column(k + Nb*i);
 	}
+
+	return TC_CRYPTO_SUCCESS;
 }
 
-#define triple(a)(_double_byte(a)^(a))
+int tc_aes128_set_encrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k)
+{
+	return set_encrypt_key_otf(o, k, Nk);
+}
 
-static inline void mult_row_column(uint8_t *out, const uint8_t *in)
+int tc_aes192_set_encrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k)
 {
-	out[0] = _double_byte(in[0]) ^ triple(in[1]) ^ in[2] ^ in[3];
-	out[1] = in[0] ^ _double_byte(in[1]) ^ triple(in[2]) ^ in[3];
-	out[2] = in[0] ^ in[1] ^ _double_byte(in[2]) ^ triple(in[3]);
-	out[3] = triple(in[0]) ^ in[1] ^ in[2] ^ _double_byte(in[3]);
+	return set_encrypt_key_otf(o, k, TC_AES192_KEY_SIZE / Nb);
 }
 
-static inline void mix_columns(uint8_t *s)
+int tc_aes256_set_encrypt_key_otf(TCAesOtfKey_t o, const uint8_t *k)
 {
-	uint8_t t[Nb*Nk];
+	return set_encrypt_key_otf(o, k, TC_AES256_KEY_SIZE / Nb);
+}
 
-	mult_row_column(t, s);
-	mult_row_column(&t[Nb], s+Nb);
-	mult_row_column(&t[2 * Nb], s + (2 * Nb));
-	mult_row_column(&t[3 * Nb], s + (3 * Nb));
-	(void) _copy(s, sizeof(t), t, sizeof(t));
+static inline void add_round_key(unsigned int *s, const unsigned int *k)
+{
+	s[0] ^= k[0]; s[1] ^= k[1]; s[2] ^= k[2]; s[3] ^= k[3];
 }
 
 /*
- * This shift_rows also implements the matrix flip required for mix_columns, but
- * performs it here to reduce the number of memory operations.
+ * SubBytes and ShiftRows in one pass: row r of output column c is the
+ * substituted row r of input column c + r, so each byte is looked up once
+ * and lands directly in its shifted position.
  */
-static inline void shift_rows(uint8_t *s)
+static inline void sub_shift_rows(unsigned int *s)
 {
-	uint8_t t[Nb * Nk];
+	unsigned int t[Nb];
 
-	t[0]  = s[0]; t[1] = s[5]; t[2] = s[10]; t[3] = s[15];
-	t[4]  = s[4]; t[5] = s[9]; t[6] = s[14]; t[7] = s[3];
-	t[8]  = s[8]; t[9] = s[13]; t[10] = s[2]; t[11] = s[7];
-	t[12] = s[12]; t[13] = s[1]; t[14] = s[6]; t[15] = s[11];
-	(void) _copy(s, sizeof(t), t, sizeof(t));
+	t[0] = subbyte(s[0], 24) | subbyte(s[1], 16) | subbyte(s[2], 8) |
+	       subbyte(s[3], 0);
+	t[1] = subbyte(s[1], 24) | subbyte(s[2], 16) | subbyte(s[3], 8) |
+	       subbyte(s[0], 0);
+	t[2] = subbyte(s[2], 24) | subbyte(s[3], 16) | subbyte(s[0], 8) |
+	       subbyte(s[1], 0);
+	t[3] = subbyte(s[3], 24) | subbyte(s[0], 16) | subbyte(s[1], 8) |
+	       subbyte(s[2], 0);
+	s[0] = t[0]; s[1] = t[1]; s[2] = t[2]; s[3] = t[3];
+}
+
+/* doubles the four bytes of a column at once */
+#define xtime_column(a)((((a) & 0x7f7f7f7f) << 1) ^ \
+			 ((((a) >> 7) & 0x01010101) * 0x1b))
+
+/*
+ * With r1, r2 and r3 the column rotated up by one, two and three rows, row i
+ * of 2(a ^ r1) ^ r1 ^ r2 ^ r3 is 2a[i] ^ 3a[i+1] ^ a[i+2] ^ a[i+3], which is
+ * MixColumns.
+ */
+static inline unsigned int mix_column(unsigned int a)
+{
+	unsigned int r1 = rotword(a);
+	unsigned int r2 = rotword(r1);
+
+	return xtime_column(a ^ r1) ^ r1 ^ r2 ^ rotword(r2);
+}
+
+static inline void mix_columns(unsigned int *s)
+{
+	s[0] = mix_column(s[0]);
+	s[1] = mix_column(s[1]);
+	s[2] = mix_column(s[2]);
+	s[3] = mix_column(s[3]);
+}
+
+static inline void encrypt_round(unsigned int *state, const unsigned int *k)
+{
+	sub_shift_rows(state);
+	mix_columns(state);
+	add_round_key(state, k);
+}
+
+static void encrypt_block(uint8_t *out, const uint8_t *in,
+			  const TCAesKeySched_t s)
+{
+	const unsigned int *rk = s->words;
+	unsigned int state[Nb];
+
+	state[0] = load_column(in);
+	state[1] = load_column(in + 4);
+	state[2] = load_column(in + 8);
+	state[3] = load_column(in + 12);
+	add_round_key(state, rk);
+
+	/*
+	 * The rounds are fully unrolled: the two or four extra rounds of
+	 * AES-192 and AES-256 fall through into the AES-128 sequence, so each
+	 * key size costs exactly its own rounds. Unknown round counts are
+	 * processed as AES-128 by _tc_aes_rounds, which keeps every access
+	 * inside the schedule.
+	 */
+	switch (_tc_aes_rounds(s)) {
+	case 14:
+		encrypt_round(state, rk + Nb);
+		encrypt_round(state, rk + 2 * Nb);
+		rk += 2 * Nb;
+		/* fall through */
+	case 12:
+		encrypt_round(state, rk + Nb);
+		encrypt_round(state, rk + 2 * Nb);
+		rk += 2 * Nb;
+		/* fall through */
+	default:
+		encrypt_round(state, rk + Nb);
+		encrypt_round(state, rk + 2 * Nb);
+		encrypt_round(state, rk + 3 * Nb);
+		encrypt_round(state, rk + 4 * Nb);
+		encrypt_round(state, rk + 5 * Nb);
+		encrypt_round(state, rk + 6 * Nb);
+		encrypt_round(state, rk + 7 * Nb);
+		encrypt_round(state, rk + 8 * Nb);
+		encrypt_round(state, rk + 9 * Nb);
+	}
+
+	sub_shift_rows(state);
+	add_round_key(state, rk + 10 * Nb);
+
+	store_column(out, state[0]);
+	store_column(out + 4, state[1]);
+	store_column(out + 8, state[2]);
+	store_column(out + 12, state[3]);
+
+	/* zeroing out the state buffer */
+	_set(state, TC_ZERO_BYTE, sizeof(state));
+}
+
+/*
+ * Encryption under an on-the-fly key. w holds the last nk schedule words,
+ * word i in w[i % nk]; each step overwrites word i - nk with word i, so the
+ * round keys are produced in order without storing more than the key.
+ */
+static void encrypt_block_otf(uint8_t *out, const uint8_t *in,
+			      const TCAesKeySched_t s)
+{
+	const struct tc_aes_otf_key_struct *o = (const void *) s;
+	unsigned int w[TC_AES256_KEY_SIZE/Nb];
+	unsigned int state[Nb];
+	unsigned int nr = o->rounds & ~TC_AES_OTF;
+	unsigned int nk, i, p, r, c;
+
+	/* unknown round counts are processed as AES-128, as below */
+	if (nr != 12 && nr != 14) {
+		nr = Nr;
+	}
+	nk = nr - 6;
+	for (i = 0; i < nk; ++i) {
+		w[i] = o->words[i];
+	}
+
+	state[0] = load_column(in);
+	state[1] = load_column(in + 4);
+	state[2] = load_column(in + 8);
+	state[3] = load_column(in + 12);
+	add_round_key(state, w);
+
+	i = Nb;
+	p = Nb % nk;
+	for (r = 1; r <= nr; ++r) {
+		sub_shift_rows(state);
+		if (r < nr) {
+			mix_columns(state);
+		}
+		for (c = 0; c < Nb; ++c) {
+			if (i >= nk) {
+				w[p] ^= expand_word(w[p == 0 ? nk - 1 : p - 1],
+						    p, i, nk);
+			}
+			state[c] ^= w[p];
+			++i;
+			p = (p + 1 == nk) ? 0 : p + 1;
+		}
+	}
+
+	store_column(out, state[0]);
+	store_column(out + 4, state[1]);
+	store_column(out + 8, state[2]);
+	store_column(out + 12, state[3]);
+
+	/* zeroing out the state and key buffers */
+	_set(state, TC_ZERO_BYTE, sizeof(state));
+	_set(w, TC_ZERO_BYTE, sizeof(w));
 }
 
 int tc_aes_encrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
 {
-	uint8_t state[Nk*Nb];
-	unsigned int i;
+	if (out == (uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (in == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (s == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
 
+	if (s->rounds & TC_AES_OTF) {
+		encrypt_block_otf(out, in, s);
+		return TC_CRYPTO_SUCCESS;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_encrypt(out, in, s);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	encrypt_block(out, in, s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_encrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s)
+{
 	if (out == (uint8_t *) 0) {
 		return TC_CRYPTO_FAIL;
 	} else if (in == (const uint8_t *) 0) {
@@ -168,24 +400,70 @@ int tc_aes_encrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
 		return TC_CRYPTO_FAIL;
 	}
 
-	(void)_copy(state, sizeof(state), in, sizeof(state));
-	add_round_key(state, s->words);
+	if (s->rounds & TC_AES_OTF) {
+		for (; nblocks > 0; --nblocks) {
+			encrypt_block_otf(out, in, s);
+			in += TC_AES_BLOCK_SIZE;
+			out += TC_AES_BLOCK_SIZE;
+		}
+		return TC_CRYPTO_SUCCESS;
+	}
 
-	for (i = 0; i < (Nr - 1); ++i) {
-		sub_bytes(state);
-		shift_rows(state);
-		mix_columns(state);
-		add_round_key(state, s->words + Nb*(i+1));
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_encrypt_blocks(out, in, nblocks, s);
+		return TC_CRYPTO_SUCCESS;
 	}
+#endif
 
-	sub_bytes(state);
-	shift_rows(state);
-	add_round_key(state, s->words + Nb*(i+1));
+	for (; nblocks > 0; --nblocks) {
+		encrypt_block(out, in, s);
+		in += TC_AES_BLOCK_SIZE;
+		out += TC_AES_BLOCK_SIZE;
+	}
 
-	(void)_copy(out, sizeof(state), state, sizeof(state));
+	return TC_CRYPTO_SUCCESS;
+}
 
-	/* zeroing out the state buffer */
-	_set(state, TC_ZERO_BYTE, sizeof(state));
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+/* on-the-fly keys keep a multi-key batch off the AES-NI routines */
+static int has_otf_key(const TCAesJob_t jobs, unsigned int njobs)
+{
+	unsigned int j;
+
+	for (j = 0; j < njobs; ++j) {
+		if (jobs[j].sched->rounds & TC_AES_OTF) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * The byte-oriented engine has no parallel lanes to fill, so it runs the
+ * entries of a multi-key batch one after the other.
+ */
+int tc_aes_encrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	unsigned int j;
+
+	if (_tc_aes_check_jobs(jobs, njobs) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available() && !has_otf_key(jobs, njobs)) {
+		_tc_aesni_encrypt_jobs(jobs, njobs);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	for (j = 0; j < njobs; ++j) {
+		(void)tc_aes_encrypt_blocks(jobs[j].out, jobs[j].in,
+					jobs[j].nblocks, jobs[j].sched);
+	}
 
 	return TC_CRYPTO_SUCCESS;
 }
@@ -0,0 +1,96 @@
+/* aes_internal.h - TinyCrypt interfaces shared by the AES engines */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Not installed: declarations only the engines and modes under source/ use
+ * between themselves.
+ */
+
+#ifndef __TC_AES_INTERNAL_H__
+#define __TC_AES_INTERNAL_H__
+
+#include <tinycrypt/aes.h>
+
+/*
+ * Checks the entries of a multi-key batch as tc_aes_encrypt_jobs and
+ * tc_aes_decrypt_jobs document: returns TC_CRYPTO_FAIL if jobs is NULL or
+ * the sched, in or out pointer of an entry is NULL, TC_CRYPTO_SUCCESS
+ * otherwise.
+ */
+int _tc_aes_check_jobs(const TCAesJob_t jobs, unsigned int njobs);
+
+/*
+ * Key expansion step of the byte-oriented engine: returns the value XORed
+ * into word i - nk to give word i, with t word i - 1 and p equal to i % nk.
+ */
+unsigned int _tc_aes_expand_word(unsigned int t, unsigned int p,
+				 unsigned int i, unsigned int nk);
+
+/*
+ * When TINYCRYPT_ARCH_HAS_AESNI is defined, the portable engines hand all
+ * work to the following AES-NI implementation, provided that
+ * _tc_aesni_available() reports processor support for it at run time. The
+ * schedules it produces are only meaningful to these routines.
+ */
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+int _tc_aesni_available(void);
+void _tc_aesni_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k,
+			       unsigned int nk);
+void _tc_aesni_invert_schedule(TCAesKeySched_t s);
+void _tc_aesni_encrypt(uint8_t *out, const uint8_t *in,
+		       const TCAesKeySched_t s);
+void _tc_aesni_decrypt(uint8_t *out, const uint8_t *in,
+		       const TCAesKeySched_t s);
+void _tc_aesni_encrypt_blocks(uint8_t *out, const uint8_t *in,
+			      unsigned int nblocks, const TCAesKeySched_t s);
+void _tc_aesni_decrypt_blocks(uint8_t *out, const uint8_t *in,
+			      unsigned int nblocks, const TCAesKeySched_t s);
+void _tc_aesni_encrypt_jobs(const TCAesJob_t jobs, unsigned int njobs);
+void _tc_aesni_decrypt_jobs(const TCAesJob_t jobs, unsigned int njobs);
+#endif /* TINYCRYPT_ARCH_HAS_AESNI */
+
+/*
+ * Number of rounds the engines process schedule s with: unknown round
+ * counts, and those of keys the schedule has no room for, are processed
+ * as AES-128, which keeps every access inside the schedule.
+ */
+static inline unsigned int _tc_aes_rounds(const TCAesKeySched_t s)
+{
+	unsigned int nr = s->rounds;
+
+	if ((nr != 12 && nr != 14) || nr > TC_AES_MAX_ROUNDS) {
+		return Nr;
+	}
+	return nr;
+}
+
+#endif /* __TC_AES_INTERNAL_H__ */
@@ -0,0 +1,395 @@
+/* aesni_aes.c - TinyCrypt AES-NI implementation of AES */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * AES on x86 processors with the AES New Instructions. The portable engines
+ * defer to these routines whenever _tc_aesni_available() reports that the
+ * processor supports the instructions, so every mode benefits without
+ * change. The functions are compiled for the AES-NI target individually,
+ * which keeps the rest of the library runnable on processors without it.
+ *
+ * Round keys are kept in the schedule as 16-byte vectors in memory order.
+ * The decryption schedule follows the equivalent inverse cipher of FIPS-197
+ * figure 15: round keys in reverse order, inner ones passed through
+ * InvMixColumns (aesimc), as aesdec expects.
+ */
+
+#include <tinycrypt/aes.h>
+#include <tinycrypt/constants.h>
+#include <tinycrypt/utils.h>
+#include "aes_internal.h"
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+
+#define AESNI __attribute__((target("aes,sse2")))
+
+/* CPUID leaf 1, ECX bit 25 */
+#define CPUID_1_ECX_AES (1u << 25)
+
+int _tc_aesni_available(void)
+{
+	/* -1 until the processor has been probed */
+	static volatile int available = -1;
+	unsigned int eax, ebx, ecx, edx;
+
+	if (available < 0) {
+		available = __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+			    (ecx & CPUID_1_ECX_AES) != 0;
+	}
+
+	return available;
+}
+
+static inline AESNI __m128i expand_step(__m128i k, __m128i assist)
+{
+	assist = _mm_shuffle_epi32(assist, 0xff);
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 8));
+
+	return _mm_xor_si128(k, assist);
+}
+
+/* aeskeygenassist takes the round constant as an immediate */
+#define EXPAND(rk, i, rcon) \
+	(rk)[i] = expand_step((rk)[(i) - 1], \
+			      _mm_aeskeygenassist_si128((rk)[(i) - 1], rcon))
+
+static AESNI void expand_key(__m128i *rk, const uint8_t *k)
+{
+	rk[0] = _mm_loadu_si128((const __m128i *) k);
+	EXPAND(rk, 1, 0x01);
+	EXPAND(rk, 2, 0x02);
+	EXPAND(rk, 3, 0x04);
+	EXPAND(rk, 4, 0x08);
+	EXPAND(rk, 5, 0x10);
+	EXPAND(rk, 6, 0x20);
+	EXPAND(rk, 7, 0x40);
+	EXPAND(rk, 8, 0x80);
+	EXPAND(rk, 9, 0x1b);
+	EXPAND(rk, 10, 0x36);
+}
+
+/*
+ * SubWord of w, rotated first if rot is set: aeskeygenassist computes both
+ * from its second word, with a zero round constant here.
+ */
+static inline AESNI unsigned int assist_word(unsigned int w, int rot)
+{
+	__m128i a = _mm_aeskeygenassist_si128(_mm_set1_epi32((int) w), 0);
+
+	return (unsigned int) _mm_cvtsi128_si32(rot ? _mm_srli_si128(a, 4) : a);
+}
+
+/*
+ * FIPS-197 key expansion of the longer keys, one memory-order word at a
+ * time; the round constant lands in the first byte of the word.
+ */
+static AESNI void expand_key_words(unsigned int *w, const uint8_t *k,
+				   unsigned int nk)
+{
+	const uint8_t rconst[9] = {
+		0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+	};
+	unsigned int i;
+	unsigned int t;
+
+	(void)_copy((uint8_t *) w, Nb * nk, k, Nb * nk);
+	for (i = nk; i < Nb * (nk + 7); ++i) {
+		t = w[i - 1];
+		if ((i % nk) == 0) {
+			t = assist_word(t, 1) ^ rconst[i / nk];
+		} else if (nk > 6 && (i % nk) == 4) {
+			t = assist_word(t, 0);
+		}
+		w[i] = w[i - nk] ^ t;
+	}
+}
+
+AESNI void _tc_aesni_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k,
+				     unsigned int nk)
+{
+	__m128i rk[Nr + 1];
+	unsigned int i;
+
+	s->rounds = nk + 6;
+	if (nk != Nk) {
+		expand_key_words(s->words, k, nk);
+		return;
+	}
+
+	expand_key(rk, k);
+	for (i = 0; i <= Nr; ++i) {
+		_mm_storeu_si128((__m128i *) &s->words[Nb * i], rk[i]);
+	}
+
+	_set(rk, 0, sizeof(rk));
+}
+
+AESNI void _tc_aesni_invert_schedule(TCAesKeySched_t s)
+{
+	__m128i rk[TC_AES_MAX_ROUNDS + 1];
+	unsigned int nr = _tc_aes_rounds(s);
+	unsigned int i;
+
+	for (i = 0; i <= nr; ++i) {
+		rk[i] = _mm_loadu_si128((const __m128i *) &s->words[Nb * i]);
+	}
+	_mm_storeu_si128((__m128i *) &s->words[0], rk[nr]);
+	for (i = 1; i < nr; ++i) {
+		_mm_storeu_si128((__m128i *) &s->words[Nb * i],
+				 _mm_aesimc_si128(rk[nr - i]));
+	}
+	_mm_storeu_si128((__m128i *) &s->words[Nb * nr], rk[0]);
+
+	_set(rk, 0, sizeof(rk));
+}
+
+#define ENC(b, rk, i) b = _mm_aesenc_si128(b, _mm_loadu_si128((rk) + (i)))
+#define DEC(b, rk, i) b = _mm_aesdec_si128(b, _mm_loadu_si128((rk) + (i)))
+
+/*
+ * The single-block routines are fully unrolled, the extra rounds of AES-192
+ * and AES-256 falling through into the AES-128 sequence.
+ */
+AESNI void _tc_aesni_encrypt(uint8_t *out, const uint8_t *in,
+			     const TCAesKeySched_t s)
+{
+	const __m128i *rk = (const __m128i *) s->words;
+	__m128i b;
+
+	b = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in),
+			  _mm_loadu_si128(rk));
+	switch (_tc_aes_rounds(s)) {
+	case 14:
+		ENC(b, rk, 1);
+		ENC(b, rk, 2);
+		rk += 2;
+		/* fall through */
+	case 12:
+		ENC(b, rk, 1);
+		ENC(b, rk, 2);
+		rk += 2;
+		/* fall through */
+	default:
+		ENC(b, rk, 1);
+		ENC(b, rk, 2);
+		ENC(b, rk, 3);
+		ENC(b, rk, 4);
+		ENC(b, rk, 5);
+		ENC(b, rk, 6);
+		ENC(b, rk, 7);
+		ENC(b, rk, 8);
+		ENC(b, rk, 9);
+	}
+	b = _mm_aesenclast_si128(b, _mm_loadu_si128(rk + 10));
+	_mm_storeu_si128((__m128i *) out, b);
+}
+
+AESNI void _tc_aesni_decrypt(uint8_t *out, const uint8_t *in,
+			     const TCAesKeySched_t s)
+{
+	const __m128i *rk = (const __m128i *) s->words;
+	__m128i b;
+
+	b = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in),
+			  _mm_loadu_si128(rk));
+	switch (_tc_aes_rounds(s)) {
+	case 14:
+		DEC(b, rk, 1);
+		DEC(b, rk, 2);
+		rk += 2;
+		/* fall through */
+	case 12:
+		DEC(b, rk, 1);
+		DEC(b, rk, 2);
+		rk += 2;
+		/* fall through */
+	default:
+		DEC(b, rk, 1);
+		DEC(b, rk, 2);
+		DEC(b, rk, 3);
+		DEC(b, rk, 4);
+		DEC(b, rk, 5);
+		DEC(b, rk, 6);
+		DEC(b, rk, 7);
+		DEC(b, rk, 8);
+		DEC(b, rk, 9);
+	}
+	b = _mm_aesdeclast_si128(b, _mm_loadu_si128(rk + 10));
+	_mm_storeu_si128((__m128i *) out, b);
+}
+
+/*
+ * The multi-block routines keep TC_AES_PARALLEL_BLOCKS independent blocks in
+ * flight, which hides the latency of aesenc/aesdec behind their throughput.
+ * They are instantiated once per key size with nr a constant, so that the
+ * compiler specializes and unrolls each round sequence; only the key sizes
+ * the schedules have room for are instantiated.
+ */
+static inline AESNI __attribute__((always_inline))
+void encrypt_blocks(uint8_t *out, const uint8_t *in, unsigned int nblocks,
+		    const TCAesKeySched_t s, const unsigned int nr)
+{
+	__m128i rk[TC_AES_MAX_ROUNDS + 1];
+	__m128i b[TC_AES_PARALLEL_BLOCKS];
+	unsigned int i, j, n;
+
+	for (i = 0; i <= nr; ++i) {
+		rk[i] = _mm_loadu_si128((const __m128i *) &s->words[Nb * i]);
+	}
+	while (nblocks > 0) {
+		n = (nblocks < TC_AES_PARALLEL_BLOCKS) ?
+		    nblocks : TC_AES_PARALLEL_BLOCKS;
+		for (j = 0; j < n; ++j) {
+			b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)
+					     (in + TC_AES_BLOCK_SIZE * j)), rk[0]);
+		}
+		for (i = 1; i < nr; ++i) {
+			for (j = 0; j < n; ++j) {
+				b[j] = _mm_aesenc_si128(b[j], rk[i]);
+			}
+		}
+		for (j = 0; j < n; ++j) {
+			_mm_storeu_si128((__m128i *)(out + TC_AES_BLOCK_SIZE * j),
+					 _mm_aesenclast_si128(b[j], rk[nr]));
+		}
+		in += TC_AES_BLOCK_SIZE * n;
+		out += TC_AES_BLOCK_SIZE * n;
+		nblocks -= n;
+	}
+}
+
+static inline AESNI __attribute__((always_inline))
+void decrypt_blocks(uint8_t *out, const uint8_t *in, unsigned int nblocks,
+		    const TCAesKeySched_t s, const unsigned int nr)
+{
+	__m128i rk[TC_AES_MAX_ROUNDS + 1];
+	__m128i b[TC_AES_PARALLEL_BLOCKS];
+	unsigned int i, j, n;
+
+	for (i = 0; i <= nr; ++i) {
+		rk[i] = _mm_loadu_si128((const __m128i *) &s->words[Nb * i]);
+	}
+	while (nblocks > 0) {
+		n = (nblocks < TC_AES_PARALLEL_BLOCKS) ?
+		    nblocks : TC_AES_PARALLEL_BLOCKS;
+		for (j = 0; j < n; ++j) {
+			b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)
+					     (in + TC_AES_BLOCK_SIZE * j)), rk[0]);
+		}
+		for (i = 1; i < nr; ++i) {
+			for (j = 0; j < n; ++j) {
+				b[j] = _mm_aesdec_si128(b[j], rk[i]);
+			}
+		}
+		for (j = 0; j < n; ++j) {
+			_mm_storeu_si128((__m128i *)(out + TC_AES_BLOCK_SIZE * j),
+					 _mm_aesdeclast_si128(b[j], rk[nr]));
+		}
+		in += TC_AES_BLOCK_SIZE * n;
+		out += TC_AES_BLOCK_SIZE * n;
+		nblocks -= n;
+	}
+}
+
+AESNI void _tc_aesni_encrypt_blocks(uint8_t *out, const uint8_t *in,
+				    unsigned int nblocks,
+				    const TCAesKeySched_t s)
+{
+	switch (_tc_aes_rounds(s)) {
+#if TC_AES_MAX_ROUNDS >= 14
+	case 14:
+		encrypt_blocks(out, in, nblocks, s, 14);
+		break;
+#endif
+#if TC_AES_MAX_ROUNDS >= 12
+	case 12:
+		encrypt_blocks(out, in, nblocks, s, 12);
+		break;
+#endif
+	default:
+		encrypt_blocks(out, in, nblocks, s, Nr);
+	}
+}
+
+AESNI void _tc_aesni_decrypt_blocks(uint8_t *out, const uint8_t *in,
+				    unsigned int nblocks,
+				    const TCAesKeySched_t s)
+{
+	switch (_tc_aes_rounds(s)) {
+#if TC_AES_MAX_ROUNDS >= 14
+	case 14:
+		decrypt_blocks(out, in, nblocks, s, 14);
+		break;
+#endif
+#if TC_AES_MAX_ROUNDS >= 12
+	case 12:
+		decrypt_blocks(out, in, nblocks, s, 12);
+		break;
+#endif
+	default:
+		decrypt_blocks(out, in, nblocks, s, Nr);
+	}
+}
+
+/*
+ * Processors with AES-NI execute out of order and overlap the unrolled
+ * single-block sequences of independent blocks by themselves, so multi-key
+ * batches simply run them block by block; interleaving lanes explicitly,
+ * each with its own key pointer, only adds bookkeeping.
+ */
+AESNI void _tc_aesni_encrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	unsigned int j, i;
+
+	for (j = 0; j < njobs; ++j) {
+		for (i = 0; i < jobs[j].nblocks; ++i) {
+			_tc_aesni_encrypt(jobs[j].out + TC_AES_BLOCK_SIZE * i,
+					  jobs[j].in + TC_AES_BLOCK_SIZE * i,
+					  jobs[j].sched);
+		}
+	}
+}
+
+AESNI void _tc_aesni_decrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	unsigned int j, i;
+
+	for (j = 0; j < njobs; ++j) {
+		for (i = 0; i < jobs[j].nblocks; ++i) {
+			_tc_aesni_decrypt(jobs[j].out + TC_AES_BLOCK_SIZE * i,
+					  jobs[j].in + TC_AES_BLOCK_SIZE * i,
+					  jobs[j].sched);
+		}
+	}
+}
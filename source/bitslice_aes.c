@@ -0,0 +1,1030 @@
+/* bitslice_aes.c - TinyCrypt bitsliced constant-time AES implementation */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This engine evaluates AES with boolean operations only: there are no table
+ * lookups and no branches depending on secret data, so its timing does not
+ * leak the key or the data through the cache or the branch predictor.
+ *
+ * The state of four blocks is kept in eight 64-bit words q[0..7], word q[i]
+ * holding bit i of all 64 state bytes. Bit 16 * r + 4 * c + j of every word
+ * belongs to row r and column c of block j, so each 16-bit chunk of a word
+ * is one state row: ShiftRows rotates inside the chunks and MixColumns
+ * combines the chunks by 64-bit rotations. The multi-block functions run two
+ * such groups side by side, i.e. eight blocks per step.
+ *
+ * Single blocks go through the same code with the unused lanes set to zero:
+ * falling back to a table based implementation for them would leak the key
+ * whenever CBC encryption or a MAC is computed under a key that is also used
+ * for bulk encryption.
+ */
+
+#include <tinycrypt/aes.h>
+#include <tinycrypt/constants.h>
+#include <tinycrypt/utils.h>
+#include "aes_internal.h"
+
+/* number of blocks held by one group of eight bitsliced words */
+#define BS_BLOCKS (4)
+
+/* number of words holding one group of blocks, or one bitsliced round key */
+#define BS_WORDS (8)
+
+/* number of groups processed side by side */
+#define BS_GROUPS (2)
+
+static inline void swapmove(uint64_t *a, uint64_t *b, uint64_t mask,
+			    unsigned int n)
+{
+	uint64_t t = ((*a >> n) ^ *b) & mask;
+
+	*b ^= t;
+	*a ^= t << n;
+}
+
+/*
+ * Transposes, within each byte lane, the 8x8 bit matrix formed by the eight
+ * words. This turns eight words of state bytes into eight bit slices and,
+ * being an involution, back.
+ */
+static void ortho(uint64_t *q)
+{
+	swapmove(&q[0], &q[1], 0x5555555555555555, 1);
+	swapmove(&q[2], &q[3], 0x5555555555555555, 1);
+	swapmove(&q[4], &q[5], 0x5555555555555555, 1);
+	swapmove(&q[6], &q[7], 0x5555555555555555, 1);
+
+	swapmove(&q[0], &q[2], 0x3333333333333333, 2);
+	swapmove(&q[1], &q[3], 0x3333333333333333, 2);
+	swapmove(&q[4], &q[6], 0x3333333333333333, 2);
+	swapmove(&q[5], &q[7], 0x3333333333333333, 2);
+
+	swapmove(&q[0], &q[4], 0x0f0f0f0f0f0f0f0f, 4);
+	swapmove(&q[1], &q[5], 0x0f0f0f0f0f0f0f0f, 4);
+	swapmove(&q[2], &q[6], 0x0f0f0f0f0f0f0f0f, 4);
+	swapmove(&q[3], &q[7], 0x0f0f0f0f0f0f0f0f, 4);
+}
+
+/*
+ * Byte r of column c of block j lands in bit (16 * r + 4 * c + j) of the
+ * slices. After ortho, bit p of slice i comes from bit i of byte lane
+ * (p >> 3) of word (p & 7), which is where the bytes are gathered to.
+ */
+static void bs_load(uint64_t *q, const uint8_t *in, unsigned int nblocks)
+{
+	unsigned int j, c, r, p;
+
+	_set(q, 0, BS_WORDS * sizeof(uint64_t));
+	for (j = 0; j < nblocks; ++j) {
+		for (c = 0; c < Nb; ++c) {
+			for (r = 0; r < 4; ++r) {
+				p = 16 * r + 4 * c + j;
+				q[p & 7] |= (uint64_t) in[Nb * Nk * j + 4 * c + r] <<
+					    (8 * (p >> 3));
+			}
+		}
+	}
+	ortho(q);
+}
+
+static void bs_store(uint8_t *out, uint64_t *q, unsigned int nblocks)
+{
+	unsigned int j, c, r, p;
+
+	ortho(q);
+	for (j = 0; j < nblocks; ++j) {
+		for (c = 0; c < Nb; ++c) {
+			for (r = 0; r < 4; ++r) {
+				p = 16 * r + 4 * c + j;
+				out[Nb * Nk * j + 4 * c + r] =
+					(uint8_t)(q[p & 7] >> (8 * (p >> 3)));
+			}
+		}
+	}
+}
+
+/* Bitslices round keys w[0..BS_BLOCKS-1], one for each block of a group. */
+static void bs_load_keys(uint64_t *q, const unsigned int *const *w)
+{
+	unsigned int j, c, r, p;
+	uint8_t v;
+
+	_set(q, 0, BS_WORDS * sizeof(uint64_t));
+	for (c = 0; c < Nb; ++c) {
+		for (r = 0; r < 4; ++r) {
+			for (j = 0; j < BS_BLOCKS; ++j) {
+				p = 16 * r + 4 * c + j;
+				v = (uint8_t)(w[j][c] >> (24 - 8 * r));
+				q[p & 7] |= (uint64_t) v << (8 * (p >> 3));
+			}
+		}
+	}
+	ortho(q);
+}
+
+/* Bitslices round key w, replicated in the lanes of all four blocks. */
+static void bs_load_key(uint64_t *q, const unsigned int *w)
+{
+	const unsigned int *l[BS_BLOCKS] = { w, w, w, w };
+
+	bs_load_keys(q, l);
+}
+
+/* number of the n blocks at hand that fall into group g */
+static inline unsigned int group_blocks(unsigned int n, unsigned int g)
+{
+	n -= BS_BLOCKS * g;
+	return (n < BS_BLOCKS) ? n : BS_BLOCKS;
+}
+
+static void bs_load_schedule(uint64_t *sk, const TCAesKeySched_t s,
+			     unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i <= nr; ++i) {
+		bs_load_key(sk + BS_WORDS * i, s->words + Nb * i);
+	}
+}
+
+/*
+ * SubBytes on all bytes of the slices, using the circuit by Boyar and
+ * Peralta, "A new combinational logic minimization technique with
+ * applications to cryptology" (https://eprint.iacr.org/2009/191.pdf).
+ * Inputs x0..x7 and outputs s0..s7 are numbered from the most significant
+ * bit down.
+ */
+static void sub_bytes(uint64_t *q)
+{
+	uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+	uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11;
+	uint64_t y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+	uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8;
+	uint64_t z9, z10, z11, z12, z13, z14, z15, z16, z17;
+	uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11;
+	uint64_t t12, t13, t14, t15, t16, t17, t18, t19, t20, t21, t22;
+	uint64_t t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33;
+	uint64_t t34, t35, t36, t37, t38, t39, t40, t41, t42, t43, t44;
+	uint64_t t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55;
+	uint64_t t56, t57, t58, t59, t60, t61, t62, t63, t64, t65, t66;
+	uint64_t t67;
+
+	x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+	x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+	/* top linear transformation */
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	/* non-linear section */
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	/* bottom linear transformation */
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	q[7] = t59 ^ t63;
+	q[1] = t56 ^ ~t62;
+	q[0] = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	q[4] = t53 ^ t66;
+	q[3] = t51 ^ t66;
+	q[2] = t47 ^ t65;
+	q[6] = t64 ^ ~q[4];
+	q[5] = t55 ^ ~t67;
+}
+
+/*
+ * Inverse of the affine transformation of the S-box, including its
+ * constant: bit i of the result is x(i+2) ^ x(i+5) ^ x(i+7) ^ bit i of 0x05.
+ */
+static void inv_affine(uint64_t *q)
+{
+	uint64_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+	uint64_t q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+
+	q[0] = ~(q2 ^ q5 ^ q7);
+	q[1] = q3 ^ q6 ^ q0;
+	q[2] = ~(q4 ^ q7 ^ q1);
+	q[3] = q5 ^ q0 ^ q2;
+	q[4] = q6 ^ q1 ^ q3;
+	q[5] = q7 ^ q2 ^ q4;
+	q[6] = q0 ^ q3 ^ q5;
+	q[7] = q1 ^ q4 ^ q6;
+}
+
+/*
+ * The S-box is the field inversion followed by the affine transformation,
+ * so the inversion is inv_affine(S(x)) and InvSubBytes is
+ * inv_affine(S(inv_affine(x))).
+ */
+static void inv_sub_bytes(uint64_t *q)
+{
+	inv_affine(q);
+	sub_bytes(q);
+	inv_affine(q);
+}
+
+static inline void add_round_key(uint64_t *q, const uint64_t *sk)
+{
+	q[0] ^= sk[0]; q[1] ^= sk[1]; q[2] ^= sk[2]; q[3] ^= sk[3];
+	q[4] ^= sk[4]; q[5] ^= sk[5]; q[6] ^= sk[6]; q[7] ^= sk[7];
+}
+
+/* Row r of every block is rotated by r columns, i.e. by 4 * r bits. */
+static inline uint64_t shift_row_bits(uint64_t x)
+{
+	return (x & 0x000000000000ffff) |
+	       ((x & 0x00000000fff00000) >> 4) |
+	       ((x & 0x00000000000f0000) << 12) |
+	       ((x & 0x0000ff0000000000) >> 8) |
+	       ((x & 0x000000ff00000000) << 8) |
+	       ((x & 0xf000000000000000) >> 12) |
+	       ((x & 0x0fff000000000000) << 4);
+}
+
+static inline uint64_t inv_shift_row_bits(uint64_t x)
+{
+	return (x & 0x000000000000ffff) |
+	       ((x & 0x000000000fff0000) << 4) |
+	       ((x & 0x00000000f0000000) >> 12) |
+	       ((x & 0x0000ff0000000000) >> 8) |
+	       ((x & 0x000000ff00000000) << 8) |
+	       ((x & 0xfff0000000000000) >> 4) |
+	       ((x & 0x000f000000000000) << 12);
+}
+
+static inline void shift_rows(uint64_t *q)
+{
+	unsigned int i;
+
+	for (i = 0; i < 8; ++i) {
+		q[i] = shift_row_bits(q[i]);
+	}
+}
+
+static inline void inv_shift_rows(uint64_t *q)
+{
+	unsigned int i;
+
+	for (i = 0; i < 8; ++i) {
+		q[i] = inv_shift_row_bits(q[i]);
+	}
+}
+
+/* rotating by 16 bits aligns row r + 1 with row r */
+static inline uint64_t rotr16(uint64_t x)
+{
+	return (x >> 16) | (x << 48);
+}
+
+static inline uint64_t rotr32(uint64_t x)
+{
+	return (x >> 32) | (x << 32);
+}
+
+/*
+ * Row r of the result is 2 * a(r) ^ 3 * a(r + 1) ^ a(r + 2) ^ a(r + 3),
+ * computed as 2 * b ^ a(r + 1) ^ b(r + 2) with b(r) = a(r) ^ a(r + 1).
+ * Doubling moves every slice one bit up and folds the top slice back in
+ * according to the polynomial 0x1b.
+ */
+static void mix_columns(uint64_t *q)
+{
+	uint64_t a0 = q[0], a1 = q[1], a2 = q[2], a3 = q[3];
+	uint64_t a4 = q[4], a5 = q[5], a6 = q[6], a7 = q[7];
+	uint64_t r0 = rotr16(a0), r1 = rotr16(a1), r2 = rotr16(a2);
+	uint64_t r3 = rotr16(a3), r4 = rotr16(a4), r5 = rotr16(a5);
+	uint64_t r6 = rotr16(a6), r7 = rotr16(a7);
+	uint64_t b0 = a0 ^ r0, b1 = a1 ^ r1, b2 = a2 ^ r2, b3 = a3 ^ r3;
+	uint64_t b4 = a4 ^ r4, b5 = a5 ^ r5, b6 = a6 ^ r6, b7 = a7 ^ r7;
+
+	q[0] = b7 ^ r0 ^ rotr32(b0);
+	q[1] = b0 ^ b7 ^ r1 ^ rotr32(b1);
+	q[2] = b1 ^ r2 ^ rotr32(b2);
+	q[3] = b2 ^ b7 ^ r3 ^ rotr32(b3);
+	q[4] = b3 ^ b7 ^ r4 ^ rotr32(b4);
+	q[5] = b4 ^ r5 ^ rotr32(b5);
+	q[6] = b5 ^ r6 ^ rotr32(b6);
+	q[7] = b6 ^ r7 ^ rotr32(b7);
+}
+
+/*
+ * InvMixColumns is MixColumns preceded by a(r) ^= 4 * (a(r) ^ a(r + 2)),
+ * see "The Design of Rijndael", section 4.1.3.
+ */
+static void inv_mix_columns(uint64_t *q)
+{
+	uint64_t c0, c1, c2, c3, c4, c5, c6, c7;
+
+	c0 = q[0] ^ rotr32(q[0]); c1 = q[1] ^ rotr32(q[1]);
+	c2 = q[2] ^ rotr32(q[2]); c3 = q[3] ^ rotr32(q[3]);
+	c4 = q[4] ^ rotr32(q[4]); c5 = q[5] ^ rotr32(q[5]);
+	c6 = q[6] ^ rotr32(q[6]); c7 = q[7] ^ rotr32(q[7]);
+
+	/* multiplying by 4 is doubling twice */
+	q[0] ^= c6;
+	q[1] ^= c6 ^ c7;
+	q[2] ^= c0 ^ c7;
+	q[3] ^= c1 ^ c6;
+	q[4] ^= c2 ^ c6 ^ c7;
+	q[5] ^= c3 ^ c7;
+	q[6] ^= c4;
+	q[7] ^= c5;
+
+	mix_columns(q);
+}
+
+/* sliced round key i of the group starting at word g of the slices */
+#define KEY(sk, kstep, g, i) \
+	((sk) + (kstep) * ((g) / BS_WORDS) + BS_WORDS * (i))
+
+/*
+ * Encrypts the ngroups groups of slices in q under the nr + 1 sliced keys
+ * at sk + kstep * g for group g, kstep being 0 when all groups share one
+ * key; the groups are processed step by step so that their instructions
+ * interleave.
+ */
+static void bs_encrypt(uint64_t *q, unsigned int ngroups, const uint64_t *sk,
+		       unsigned int kstep, unsigned int nr)
+{
+	unsigned int n = BS_WORDS * ngroups;
+	unsigned int i, g;
+
+	for (g = 0; g < n; g += BS_WORDS) {
+		add_round_key(q + g, KEY(sk, kstep, g, 0));
+	}
+	for (i = 1; i < nr; ++i) {
+		for (g = 0; g < n; g += BS_WORDS) {
+			sub_bytes(q + g);
+		}
+		for (g = 0; g < n; g += BS_WORDS) {
+			shift_rows(q + g);
+			mix_columns(q + g);
+			add_round_key(q + g, KEY(sk, kstep, g, i));
+		}
+	}
+	for (g = 0; g < n; g += BS_WORDS) {
+		sub_bytes(q + g);
+		shift_rows(q + g);
+		add_round_key(q + g, KEY(sk, kstep, g, nr));
+	}
+}
+
+static void bs_decrypt(uint64_t *q, unsigned int ngroups, const uint64_t *sk,
+		       unsigned int kstep, unsigned int nr)
+{
+	unsigned int n = BS_WORDS * ngroups;
+	unsigned int i, g;
+
+	for (g = 0; g < n; g += BS_WORDS) {
+		add_round_key(q + g, KEY(sk, kstep, g, nr));
+	}
+	for (i = nr - 1; i > 0; --i) {
+		for (g = 0; g < n; g += BS_WORDS) {
+			inv_shift_rows(q + g);
+			inv_sub_bytes(q + g);
+		}
+		for (g = 0; g < n; g += BS_WORDS) {
+			add_round_key(q + g, KEY(sk, kstep, g, i));
+			inv_mix_columns(q + g);
+		}
+	}
+	for (g = 0; g < n; g += BS_WORDS) {
+		inv_shift_rows(q + g);
+		inv_sub_bytes(q + g);
+		add_round_key(q + g, KEY(sk, kstep, g, 0));
+	}
+}
+
+static inline unsigned int rotword(unsigned int a)
+{
+	return (((a) >> 24)|((a) << 8));
+}
+
+/* number of key words substituted by one pass of the bitsliced S-box */
+#define BS_KEY_WORDS (BS_BLOCKS * Nk)
+
+/*
+ * SubWord of the n <= BS_KEY_WORDS words a[] through the bitsliced S-box,
+ * so that key setup is constant-time; the words are substituted as the
+ * bytes of up to four blocks.
+ */
+static void subwords(unsigned int *a, unsigned int n)
+{
+	uint8_t b[BS_KEY_WORDS * Nb] = { 0 };
+	uint64_t q[BS_WORDS];
+	unsigned int nblocks = (n + Nk - 1) / Nk;
+
+	(void)_copy(b, sizeof(b), (const uint8_t *) a, Nb * n);
+	bs_load(q, b, nblocks);
+	sub_bytes(q);
+	bs_store(b, q, nblocks);
+	(void)_copy((uint8_t *) a, Nb * n, b, Nb * n);
+	_set(q, 0, sizeof(q));
+	_set(b, 0, sizeof(b));
+}
+
+static const unsigned int rconst[11] = {
+	0x00000000, 0x01000000, 0x02000000, 0x04000000, 0x08000000, 0x10000000,
+	0x20000000, 0x40000000, 0x80000000, 0x1b000000, 0x36000000
+};
+
+/*
+ * FIPS-197 key expansion of n keys of nk words each, stored one after the
+ * other at k, into s[0..n-1]. The keys are expanded in lockstep, so that
+ * the words of up to BS_KEY_WORDS keys needing SubWord at the same step go
+ * through a single S-box pass; 256-bit keys take an extra SubWord in the
+ * middle of every nk words.
+ */
+static void set_encrypt_keys(TCAesKeySched_t s, const uint8_t *k,
+			     unsigned int n, unsigned int nk)
+{
+	unsigned int t[BS_KEY_WORDS];
+	unsigned int g, i, j, p, rc;
+	const uint8_t *q;
+	unsigned int *w;
+
+	for (; n > 0; n -= g, s += g, k += Nb * nk * g) {
+		g = (n < BS_KEY_WORDS) ? n : BS_KEY_WORDS;
+		for (j = 0; j < g; ++j) {
+			s[j].rounds = nk + 6;
+			for (i = 0; i < nk; ++i) {
+				q = k + Nb * (nk * j + i);
+				s[j].words[i] = ((unsigned int) q[0] << 24) |
+					((unsigned int) q[1] << 16) |
+					((unsigned int) q[2] << 8) | (q[3]);
+			}
+		}
+
+		for (i = nk; i < (Nb * (nk + 7)); ++i) {
+			p = i % nk;
+			for (j = 0; j < g; ++j) {
+				t[j] = s[j].words[i-1];
+				if (p == 0) {
+					t[j] = rotword(t[j]);
+				}
+			}
+			if (p == 0 || (nk > 6 && p == 4)) {
+				subwords(t, g);
+			}
+			rc = (p == 0) ? rconst[i/nk] : 0;
+			for (j = 0; j < g; ++j) {
+				w = s[j].words;
+				w[i] = w[i-nk] ^ t[j] ^ rc;
+			}
+		}
+	}
+	_set(t, 0, sizeof(t));
+}
+
+static int set_encrypt_key(TCAesKeySched_t s, const uint8_t *k,
+			   unsigned int nk)
+{
+	if (s == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (k == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (nk + 6 > TC_AES_MAX_ROUNDS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_set_encrypt_key(s, k, nk);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	set_encrypt_keys(s, k, 1, nk);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	return set_encrypt_key(s, k, Nk);
+}
+
+int tc_aes192_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	return set_encrypt_key(s, k, TC_AES192_KEY_SIZE / Nb);
+}
+
+int tc_aes256_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	return set_encrypt_key(s, k, TC_AES256_KEY_SIZE / Nb);
+}
+
+/*
+ * The bitsliced decryption runs the straightforward inverse cipher on the
+ * encryption schedule; only the AES-NI routines need it rearranged.
+ */
+static void invert_schedule(TCAesKeySched_t s)
+{
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_invert_schedule(s);
+	}
+#else
+	(void) s;
+#endif
+}
+
+int tc_aes128_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	if (tc_aes128_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes192_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	if (tc_aes192_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes256_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	if (tc_aes256_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+/*
+ * The decryption schedule of a key pair is derived from its encryption
+ * schedule, so that the key is expanded only once.
+ */
+static int set_key_pair(TCAesKeyPair_t p, const uint8_t *k,
+			int (*set_enc)(TCAesKeySched_t, const uint8_t *))
+{
+	if (p == (TCAesKeyPair_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (set_enc(&p->enc, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	p->dec = p->enc;
+	invert_schedule(&p->dec);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes128_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+	return set_key_pair(p, k, tc_aes128_set_encrypt_key);
+}
+
+int tc_aes192_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+	return set_key_pair(p, k, tc_aes192_set_encrypt_key);
+}
+
+int tc_aes256_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+	return set_key_pair(p, k, tc_aes256_set_encrypt_key);
+}
+
+/*
+ * Batch key setup: the keys are expanded together by set_encrypt_keys, and
+ * their decryption schedules derived from the encryption ones.
+ */
+static int set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		    const uint8_t *k, unsigned int n, unsigned int nk)
+{
+	unsigned int i;
+
+	if (enc == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (k == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (nk + 6 > TC_AES_MAX_ROUNDS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		for (i = 0; i < n; ++i) {
+			_tc_aesni_set_encrypt_key(&enc[i], k + Nb * nk * i, nk);
+		}
+	} else {
+		set_encrypt_keys(enc, k, n, nk);
+	}
+#else
+	set_encrypt_keys(enc, k, n, nk);
+#endif
+
+	if (dec != (TCAesKeySched_t) 0) {
+		for (i = 0; i < n; ++i) {
+			dec[i] = enc[i];
+			invert_schedule(&dec[i]);
+		}
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes128_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, Nk);
+}
+
+int tc_aes192_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, TC_AES192_KEY_SIZE / Nb);
+}
+
+int tc_aes256_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, TC_AES256_KEY_SIZE / Nb);
+}
+
+int tc_aes_encrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s)
+{
+	uint64_t sk[BS_WORDS * (TC_AES_MAX_ROUNDS + 1)];
+	uint64_t q[BS_GROUPS * BS_WORDS];
+	unsigned int nr, n, g;
+
+	if (out == (uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (in == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (s == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_encrypt_blocks(out, in, nblocks, s);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	nr = _tc_aes_rounds(s);
+	bs_load_schedule(sk, s, nr);
+	while (nblocks > 0) {
+		n = (nblocks < BS_GROUPS * BS_BLOCKS) ? nblocks : BS_GROUPS * BS_BLOCKS;
+		for (g = 0; g * BS_BLOCKS < n; ++g) {
+			bs_load(q + BS_WORDS * g, in + TC_AES_BLOCK_SIZE * BS_BLOCKS * g,
+				group_blocks(n, g));
+		}
+		bs_encrypt(q, g, sk, 0, nr);
+		for (g = 0; g * BS_BLOCKS < n; ++g) {
+			bs_store(out + TC_AES_BLOCK_SIZE * BS_BLOCKS * g,
+				 q + BS_WORDS * g, group_blocks(n, g));
+		}
+		in += TC_AES_BLOCK_SIZE * n;
+		out += TC_AES_BLOCK_SIZE * n;
+		nblocks -= n;
+	}
+
+	/* zeroing out the sliced key and state */
+	_set(sk, 0, sizeof(sk));
+	_set(q, 0, sizeof(q));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_decrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s)
+{
+	uint64_t sk[BS_WORDS * (TC_AES_MAX_ROUNDS + 1)];
+	uint64_t q[BS_GROUPS * BS_WORDS];
+	unsigned int nr, n, g;
+
+	if (out == (uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (in == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (s == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_decrypt_blocks(out, in, nblocks, s);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	nr = _tc_aes_rounds(s);
+	bs_load_schedule(sk, s, nr);
+	while (nblocks > 0) {
+		n = (nblocks < BS_GROUPS * BS_BLOCKS) ? nblocks : BS_GROUPS * BS_BLOCKS;
+		for (g = 0; g * BS_BLOCKS < n; ++g) {
+			bs_load(q + BS_WORDS * g, in + TC_AES_BLOCK_SIZE * BS_BLOCKS * g,
+				group_blocks(n, g));
+		}
+		bs_decrypt(q, g, sk, 0, nr);
+		for (g = 0; g * BS_BLOCKS < n; ++g) {
+			bs_store(out + TC_AES_BLOCK_SIZE * BS_BLOCKS * g,
+				 q + BS_WORDS * g, group_blocks(n, g));
+		}
+		in += TC_AES_BLOCK_SIZE * n;
+		out += TC_AES_BLOCK_SIZE * n;
+		nblocks -= n;
+	}
+
+	/* zeroing out the sliced key and state */
+	_set(sk, 0, sizeof(sk));
+	_set(q, 0, sizeof(q));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_encrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
+{
+	return tc_aes_encrypt_blocks(out, in, 1, s);
+}
+
+int tc_aes_decrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
+{
+	return tc_aes_decrypt_blocks(out, in, 1, s);
+}
+
+/* number of blocks of a multi-key batch processed side by side */
+#define LANES (BS_GROUPS * BS_BLOCKS)
+
+/*
+ * Multi-key batches are cut into steps of up to LANES blocks, taken in order
+ * from block *b of entry *j on and each under the schedule of its entry.
+ * The blocks of a step must share their number of rounds, so an entry of
+ * another key size starts a new step. Returns the number of blocks taken.
+ */
+static unsigned int next_lanes(const uint8_t **in, uint8_t **out,
+			       TCAesKeySched_t *k, const TCAesJob_t jobs,
+			       unsigned int njobs, unsigned int *j,
+			       unsigned int *b)
+{
+	unsigned int n = 0;
+
+	for (; *j < njobs && n < LANES; ++*j, *b = 0) {
+		if (n > 0 && jobs[*j].nblocks > 0 &&
+		    _tc_aes_rounds(jobs[*j].sched) != _tc_aes_rounds(k[0])) {
+			break;
+		}
+		for (; *b < jobs[*j].nblocks && n < LANES; ++*b, ++n) {
+			in[n] = jobs[*j].in + TC_AES_BLOCK_SIZE * *b;
+			out[n] = jobs[*j].out + TC_AES_BLOCK_SIZE * *b;
+			k[n] = jobs[*j].sched;
+		}
+		if (*b < jobs[*j].nblocks) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Bitslices the schedules k[0..n-1] of the lanes of a multi-key step, those
+ * of group g at sk + BS_WORDS * (nr + 1) * g; the lanes left unused take the
+ * key of the first one.
+ */
+static void bs_load_lane_schedules(uint64_t *sk, const TCAesKeySched_t *k,
+				   unsigned int n, unsigned int nr)
+{
+	const unsigned int *w[BS_BLOCKS];
+	unsigned int g, i, j, l;
+
+	for (g = 0; g * BS_BLOCKS < n; ++g) {
+		for (i = 0; i <= nr; ++i) {
+			for (j = 0; j < BS_BLOCKS; ++j) {
+				l = BS_BLOCKS * g + j;
+				w[j] = k[(l < n) ? l : 0]->words + Nb * i;
+			}
+			bs_load_keys(sk + BS_WORDS * ((nr + 1) * g + i), w);
+		}
+	}
+}
+
+/*
+ * Runs a multi-key batch through the bitsliced rounds, each lane of the
+ * slices under its own key; encrypts unless decrypt is set.
+ */
+static void bs_jobs(const TCAesJob_t jobs, unsigned int njobs, int decrypt)
+{
+	uint64_t sk[BS_GROUPS * BS_WORDS * (TC_AES_MAX_ROUNDS + 1)];
+	uint64_t q[BS_GROUPS * BS_WORDS];
+	uint8_t buf[LANES][TC_AES_BLOCK_SIZE];
+	const uint8_t *in[LANES];
+	uint8_t *out[LANES];
+	TCAesKeySched_t k[LANES];
+	unsigned int n, nr, g, l;
+	unsigned int j = 0, p = 0;
+
+	while ((n = next_lanes(in, out, k, jobs, njobs, &j, &p)) > 0) {
+		nr = _tc_aes_rounds(k[0]);
+		bs_load_lane_schedules(sk, k, n, nr);
+		for (l = 0; l < n; ++l) {
+			(void)_copy(buf[l], TC_AES_BLOCK_SIZE, in[l],
+				    TC_AES_BLOCK_SIZE);
+		}
+		for (g = 0; g * BS_BLOCKS < n; ++g) {
+			bs_load(q + BS_WORDS * g, buf[BS_BLOCKS * g],
+				group_blocks(n, g));
+		}
+		if (decrypt) {
+			bs_decrypt(q, g, sk, BS_WORDS * (nr + 1), nr);
+		} else {
+			bs_encrypt(q, g, sk, BS_WORDS * (nr + 1), nr);
+		}
+		for (g = 0; g * BS_BLOCKS < n; ++g) {
+			bs_store(buf[BS_BLOCKS * g], q + BS_WORDS * g,
+				 group_blocks(n, g));
+		}
+		for (l = 0; l < n; ++l) {
+			(void)_copy(out[l], TC_AES_BLOCK_SIZE, buf[l],
+				    TC_AES_BLOCK_SIZE);
+		}
+	}
+
+	/* zeroing out the sliced keys and state */
+	_set(sk, 0, sizeof(sk));
+	_set(q, 0, sizeof(q));
+	_set(buf, 0, sizeof(buf));
+}
+
+int tc_aes_encrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	if (_tc_aes_check_jobs(jobs, njobs) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_encrypt_jobs(jobs, njobs);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	bs_jobs(jobs, njobs, 0);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_decrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	if (_tc_aes_check_jobs(jobs, njobs) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_decrypt_jobs(jobs, njobs);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	bs_jobs(jobs, njobs, 1);
+
+	return TC_CRYPTO_SUCCESS;
+}
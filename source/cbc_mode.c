@@ -79,9 +79,9 @@ int tc_cbc_mode_decrypt(uint8_t *out, unsigned int outlen, const uint8_t *in,
 			    const TCAesKeySched_t sched)
 {
 
-	uint8_t buffer[TC_AES_BLOCK_SIZE];
+	uint8_t buffer[TC_AES_PARALLEL_BLOCKS * TC_AES_BLOCK_SIZE];
 	const uint8_t *p;
-	unsigned int n, m;
+	unsigned int m;
 
 	/* sanity check the inputs */
 	if (out == (uint8_t *) 0 ||
@@ -96,19 +96,206 @@ int tc_cbc_mode_decrypt(uint8_t *out, unsigned int outlen, const uint8_t *in,
 	}
 
 	/*
-	 * Note that in == iv + ciphertext, i.e. the iv and the ciphertext are
-	 * contiguous. This allows for a very efficient decryption algorithm
-	 * that would not otherwise be possible.
+	 * Each plaintext block is the decrypted ciphertext block XORed with the
+	 * preceding ciphertext block, or with the iv for the first one. The
+	 * block decryptions are independent, so they are done in batches.
 	 */
 	p = iv;
-	for (n = m = 0; n < outlen; ++n) {
-		if ((n % TC_AES_BLOCK_SIZE) == 0) {
-			(void)tc_aes_decrypt(buffer, in, sched);
-			in += TC_AES_BLOCK_SIZE;
-			m = 0;
+	while (outlen > 0) {
+		m = (outlen < sizeof(buffer)) ? outlen : sizeof(buffer);
+		(void)tc_aes_decrypt_blocks(buffer, in, m / TC_AES_BLOCK_SIZE,
+					    sched);
+		_xor(out, buffer, p, TC_AES_BLOCK_SIZE);
+		_xor(out + TC_AES_BLOCK_SIZE, buffer + TC_AES_BLOCK_SIZE, in,
+		     m - TC_AES_BLOCK_SIZE);
+		p = in + m - TC_AES_BLOCK_SIZE;
+		out += m;
+		in += m;
+		outlen -= m;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+/* number of messages tc_cbc_mode_encrypt_multi advances side by side */
+#define CBC_MULTI_LANES (4 * TC_AES_PARALLEL_BLOCKS)
+
+int tc_cbc_mode_encrypt_multi(const TCCbcJob_t jobs, unsigned int njobs)
+{
+	struct tc_aes_job_struct aes[CBC_MULTI_LANES];
+	uint8_t buffer[CBC_MULTI_LANES * TC_AES_BLOCK_SIZE];
+	unsigned int offset[CBC_MULTI_LANES];
+	unsigned int msg[CBC_MULTI_LANES];
+	unsigned int j, k, n;
+	uint8_t *block;
+
+	/* input sanity check: */
+	if (jobs == (TCCbcJob_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+	for (j = 0; j < njobs; ++j) {
+		if (jobs[j].out == (uint8_t *) 0 ||
+		    jobs[j].in == (const uint8_t *) 0 ||
+		    jobs[j].iv == (uint8_t *) 0 ||
+		    jobs[j].sched == (TCAesKeySched_t) 0 ||
+		    (jobs[j].len % TC_AES_BLOCK_SIZE) != 0) {
+			return TC_CRYPTO_FAIL;
+		}
+	}
+
+	/*
+	 * Each lane carries a message, one block per step; the lane of a
+	 * finished message is handed to the next message of the batch.
+	 */
+	j = 0;
+	n = 0;
+	for (;;) {
+		for (k = 0; k < n; ) {
+			if (offset[k] == jobs[msg[k]].len) {
+				msg[k] = msg[--n];
+				offset[k] = offset[n];
+			} else {
+				++k;
+			}
+		}
+		for (; j < njobs && n < CBC_MULTI_LANES; ++j) {
+			if (jobs[j].len > 0) {
+				msg[n] = j;
+				offset[n++] = 0;
+			}
+		}
+		if (n == 0) {
+			break;
+		}
+
+		/* chain the next block of every message */
+		for (k = 0; k < n; ++k) {
+			block = buffer + TC_AES_BLOCK_SIZE * k;
+			_xor(block, jobs[msg[k]].iv, jobs[msg[k]].in + offset[k],
+			     TC_AES_BLOCK_SIZE);
+			aes[k].sched = jobs[msg[k]].sched;
+			aes[k].in = block;
+			aes[k].out = block;
+			aes[k].nblocks = 1;
+		}
+
+		/* encrypt them all at once */
+		if (!tc_aes_encrypt_jobs(aes, n)) {
+			return TC_CRYPTO_FAIL;
+		}
+
+		/* update the outputs and the chaining blocks */
+		for (k = 0; k < n; ++k) {
+			block = buffer + TC_AES_BLOCK_SIZE * k;
+			(void)_copy(jobs[msg[k]].out + offset[k],
+				    TC_AES_BLOCK_SIZE, block, TC_AES_BLOCK_SIZE);
+			(void)_copy(jobs[msg[k]].iv, TC_AES_BLOCK_SIZE,
+				    block, TC_AES_BLOCK_SIZE);
+			offset[k] += TC_AES_BLOCK_SIZE;
+		}
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_cbc_init(TCCbcState_t s, const uint8_t *iv,
+		const TCAesKeySched_t sched)
+{
+
+	/* input sanity check: */
+	if (s == (TCCbcState_t) 0 ||
+	    iv == (const uint8_t *) 0 ||
+	    sched == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	(void)_copy(s->iv, sizeof(s->iv), iv, TC_AES_BLOCK_SIZE);
+	s->sched = sched;
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_cbc_encrypt_update(TCCbcState_t s, uint8_t *out, const uint8_t *in,
+			  unsigned int len)
+{
+
+	/* input sanity check: */
+	if (s == (TCCbcState_t) 0 ||
+	    (len > 0 && (out == (uint8_t *) 0 || in == (const uint8_t *) 0)) ||
+	    (len % TC_AES_BLOCK_SIZE) != 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	for (; len > 0; len -= TC_AES_BLOCK_SIZE) {
+		_xor(s->iv, s->iv, in, TC_AES_BLOCK_SIZE);
+		if (!tc_aes_encrypt(s->iv, s->iv, s->sched)) {
+			return TC_CRYPTO_FAIL;
+		}
+		(void)_copy(out, TC_AES_BLOCK_SIZE, s->iv, TC_AES_BLOCK_SIZE);
+		out += TC_AES_BLOCK_SIZE;
+		in += TC_AES_BLOCK_SIZE;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_cbc_decrypt_update(TCCbcState_t s, uint8_t *out, const uint8_t *in,
+			  unsigned int len)
+{
+	uint8_t buffer[TC_AES_PARALLEL_BLOCKS * TC_AES_BLOCK_SIZE];
+	uint8_t next[TC_AES_BLOCK_SIZE];
+	unsigned int m;
+	unsigned int n;
+
+	/* input sanity check: */
+	if (s == (TCCbcState_t) 0 ||
+	    (len > 0 && (out == (uint8_t *) 0 || in == (const uint8_t *) 0)) ||
+	    (len % TC_AES_BLOCK_SIZE) != 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/*
+	 * The blocks of a batch are chained from the last to the first, so
+	 * that in place each ciphertext block is still there when the block
+	 * after it needs it.
+	 */
+	while (len > 0) {
+		m = (len < sizeof(buffer)) ? len : sizeof(buffer);
+		if (!tc_aes_decrypt_blocks(buffer, in, m / TC_AES_BLOCK_SIZE,
+					   s->sched)) {
+			return TC_CRYPTO_FAIL;
+		}
+		(void)_copy(next, sizeof(next), in + m - TC_AES_BLOCK_SIZE,
+			    TC_AES_BLOCK_SIZE);
+		for (n = m - TC_AES_BLOCK_SIZE; n > 0; n -= TC_AES_BLOCK_SIZE) {
+			_xor(out + n, buffer + n, in + n - TC_AES_BLOCK_SIZE,
+			     TC_AES_BLOCK_SIZE);
 		}
-		*out++ = buffer[m++] ^ *p++;
+		_xor(out, buffer, s->iv, TC_AES_BLOCK_SIZE);
+		(void)_copy(s->iv, sizeof(s->iv), next, sizeof(next));
+		out += m;
+		in += m;
+		len -= m;
+	}
+
+	/* zeroing out the plaintext */
+	_set(buffer, 0, sizeof(buffer));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_cbc_final(uint8_t *iv, TCCbcState_t s)
+{
+
+	/* input sanity check: */
+	if (s == (TCCbcState_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	if (iv != (uint8_t *) 0) {
+		(void)_copy(iv, TC_AES_BLOCK_SIZE, s->iv, sizeof(s->iv));
 	}
+	_set_secure(s, 0, sizeof(*s));
 
 	return TC_CRYPTO_SUCCESS;
 }
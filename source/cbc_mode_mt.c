@@ -0,0 +1,103 @@
+/* cbc_mode_mt.c - TinyCrypt implementation of multi-threaded CBC decryption */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tinycrypt/cbc_mode.h>
+#include <tinycrypt/constants.h>
+#include <tinycrypt/utils.h>
+
+/* a tc_cbc_mode_decrypt_mt call, split into chunks of chunk bytes */
+struct cbc_mt {
+	uint8_t *out;
+	const uint8_t *in;
+	unsigned int len;
+	unsigned int chunk;
+	const uint8_t *iv;
+	TCAesKeySched_t sched;
+};
+
+/* decrypts chunk i, chained to the last ciphertext block before it */
+static int cbc_chunk(void *arg, unsigned int i)
+{
+	const struct cbc_mt *c = (const struct cbc_mt *) arg;
+	unsigned int off = i * c->chunk;
+	unsigned int n = c->len - off;
+	const uint8_t *iv;
+
+	if (n > c->chunk) {
+		n = c->chunk;
+	}
+	iv = (off == 0) ? c->iv : c->in + off - TC_AES_BLOCK_SIZE;
+
+	return tc_cbc_mode_decrypt(c->out + off, n, c->in + off, n, iv,
+				   c->sched);
+}
+
+int tc_cbc_mode_decrypt_mt(uint8_t *out, unsigned int outlen,
+			   const uint8_t *in, unsigned int inlen,
+			   const uint8_t *iv, const TCAesKeySched_t sched,
+			   unsigned int chunk, unsigned int nthreads)
+{
+	struct cbc_mt c;
+
+	/* sanity check the inputs */
+	if (out == (uint8_t *) 0 ||
+	    in == (const uint8_t *) 0 ||
+	    sched == (TCAesKeySched_t) 0 ||
+	    inlen == 0 ||
+	    outlen == 0 ||
+	    (inlen % TC_AES_BLOCK_SIZE) != 0 ||
+	    (outlen % TC_AES_BLOCK_SIZE) != 0 ||
+	    outlen != inlen) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/* chunks start on block boundaries */
+	if (chunk == 0) {
+		chunk = TC_CBC_MT_CHUNK;
+	}
+	chunk -= chunk % TC_AES_BLOCK_SIZE;
+	if (chunk == 0) {
+		chunk = TC_AES_BLOCK_SIZE;
+	}
+	if (nthreads == 0) {
+		nthreads = TC_CBC_MT_THREADS;
+	}
+
+	c.out = out;
+	c.in = in;
+	c.len = inlen;
+	c.chunk = chunk;
+	c.iv = iv;
+	c.sched = sched;
+
+	return _parallel(cbc_chunk, &c, (inlen - 1) / chunk + 1, nthreads);
+}
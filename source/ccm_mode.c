@@ -66,70 +66,93 @@ static void ccm_cbc_mac(uint8_t *T, const uint8_t *data, unsigned int dlen,
 {
 
 	unsigned int i;
+	unsigned int n;
 
 	if (flag > 0) {
 		T[0] ^= (uint8_t)(dlen >> 8);
 		T[1] ^= (uint8_t)(dlen);
-		dlen += 2; i = 2;
+		i = 2;
 	} else {
 		i = 0;
 	}
 
-	while (i < dlen) {
-		T[i++ % (Nb * Nk)] ^= *data++;
-		if (((i % (Nb * Nk)) == 0) || dlen == i) {
-			(void) tc_aes_encrypt(T, T, sched);
-		}
+	while (dlen > 0) {
+		n = (dlen < Nb * Nk - i) ? dlen : Nb * Nk - i;
+		_xor(T + i, T + i, data, n);
+		(void) tc_aes_encrypt(T, T, sched);
+		data += n;
+		dlen -= n;
+		i = 0;
 	}
 }
 
 /**
- * Variation of CTR mode used in CCM.
- * The CTR mode used by CCM is slightly different than the conventional CTR
- * mode (the counter is increased before encryption, instead of after
- * encryption). Besides, it is assumed that the counter is stored in the last
- * 2 bytes of the nonce.
+ * Single pass of CCM over the payload, encrypting (or decrypting) it with
+ * the CTR mode of CCM while extending the CBC-MAC T over the plaintext.
+ * Each step encrypts the CBC-MAC block of the previous payload block side
+ * by side with the counter block of the next one, as they are independent;
+ * the last step pairs the CBC-MAC block of the last payload block with
+ * counter block 0, which masks the tag. On return, T holds the masked tag.
+ * The counter is stored in the last 2 bytes of the counter block, and is
+ * increased before encryption, from 1 on.
  */
-static int ccm_ctr_mode(uint8_t *out, unsigned int outlen, const uint8_t *in,
-			unsigned int inlen, uint8_t *ctr, const TCAesKeySched_t sched)
+static int ccm_crypt(uint8_t *out, const uint8_t *in, unsigned int len,
+		     uint8_t *T, const uint8_t *ctr, int decrypt,
+		     const TCAesKeySched_t sched)
 {
 
-	uint8_t buffer[TC_AES_BLOCK_SIZE];
-	uint8_t nonce[TC_AES_BLOCK_SIZE];
-	uint16_t block_num;
-	unsigned int i;
-
-	/* input sanity check: */
-	if (out == (uint8_t *) 0 ||
-	    in == (uint8_t *) 0 ||
-	    ctr == (uint8_t *) 0 ||
-	    sched == (TCAesKeySched_t) 0 ||
-	    inlen == 0 ||
-	    outlen == 0 ||
-	    outlen != inlen) {
-		return TC_CRYPTO_FAIL;
-	}
-
-	/* copy the counter to the nonce */
-	(void) _copy(nonce, sizeof(nonce), ctr, sizeof(nonce));
-
-	/* select the last 2 bytes of the nonce to be incremented */
-	block_num = (uint16_t) ((nonce[14] << 8)|(nonce[15]));
-	for (i = 0; i < inlen; ++i) {
-		if ((i % (TC_AES_BLOCK_SIZE)) == 0) {
+	/* CBC-MAC block and counter block, then their encryptions */
+	uint8_t blocks[2 * Nb * Nk];
+	uint8_t state[2 * Nb * Nk];
+	unsigned int nblocks = 1;
+	unsigned int block_num = 0;
+	unsigned int off;
+	unsigned int blen;
+
+	(void) _copy(state, Nb * Nk, T, Nb * Nk);
+	(void) _copy(blocks + Nb * Nk, Nb * Nk, ctr, Nb * Nk);
+	for (;;) {
+		if (len > 0) {
 			block_num++;
-			nonce[14] = (uint8_t)(block_num >> 8);
-			nonce[15] = (uint8_t)(block_num);
-			if (!tc_aes_encrypt(buffer, nonce, sched)) {
-				return TC_CRYPTO_FAIL;
-			}
+		} else {
+			block_num = 0; /* the last step encrypts counter block 0 */
+		}
+		blocks[2 * Nb * Nk - 2] = (uint8_t)(block_num >> 8);
+		blocks[2 * Nb * Nk - 1] = (uint8_t)(block_num);
+
+		/* encrypt the pending CBC-MAC block, if any, and the counter */
+		off = Nb * Nk * (2 - nblocks);
+		if (!tc_aes_encrypt_blocks(state + off, blocks + off, nblocks,
+					   sched)) {
+			return TC_CRYPTO_FAIL;
+		}
+		if (len == 0) {
+			break;
+		}
+
+		/* the next CBC-MAC block covers the plaintext of this one */
+		blen = (len < Nb * Nk) ? len : Nb * Nk;
+		if (blen < Nb * Nk) {
+			(void) _copy(blocks, Nb * Nk, state, Nb * Nk);
+		}
+		if (!decrypt) {
+			_xor(blocks, state, in, blen);
 		}
-		/* update the output */
-		*out++ = buffer[i % (TC_AES_BLOCK_SIZE)] ^ *in++;
+		_xor(out, in, state + Nb * Nk, blen);
+		if (decrypt) {
+			_xor(blocks, state, out, blen);
+		}
+		nblocks = 2;
+		out += blen;
+		in += blen;
+		len -= blen;
 	}
 
-	/* update the counter */
-	ctr[14] = nonce[14]; ctr[15] = nonce[15];
+	/* mask the tag */
+	_xor(T, state, state + Nb * Nk, Nb * Nk);
+
+	/* zeroing out the keystream */
+	_set(state, 0, sizeof(state));
 
 	return TC_CRYPTO_SUCCESS;
 }
@@ -170,9 +193,6 @@ int tc_ccm_generation_encryption(uint8_t *out, unsigned int olen,
 	if (alen > 0) {
 		ccm_cbc_mac(tag, associated_data, alen, 1, c->sched);
 	}
-	if (plen > 0) {
-		ccm_cbc_mac(tag, payload, plen, 0, c->sched);
-	}
 
 	/* ENCRYPTION: */
 
@@ -180,17 +200,14 @@ int tc_ccm_generation_encryption(uint8_t *out, unsigned int olen,
 	b[0] = 1; /* q - 1 = 2 - 1 = 1 */
 	b[14] = b[15] = TC_ZERO_BYTE;
 
-	/* encrypting payload using ctr mode: */
-	ccm_ctr_mode(out, plen, payload, plen, b, c->sched);
-
-	b[14] = b[15] = TC_ZERO_BYTE; /* restoring initial counter for ctr_mode (0):*/
-
-	/* encrypting b and adding the tag to the output: */
-	(void) tc_aes_encrypt(b, b, c->sched);
-	out += plen;
-	for (i = 0; i < c->mlen; ++i) {
-		*out++ = tag[i] ^ b[i];
+	/*
+	 * encrypting payload using ctr mode while completing the tag over
+	 * it, then adding the tag to the output:
+	 */
+	if (!ccm_crypt(out, payload, plen, tag, b, 0, c->sched)) {
+		return TC_CRYPTO_FAIL;
 	}
+	(void) _copy(out + plen, c->mlen, tag, c->mlen);
 
 	return TC_CRYPTO_SUCCESS;
 }
@@ -216,26 +233,6 @@ int tc_ccm_decryption_verification(uint8_t *out, unsigned int olen,
 	uint8_t tag[Nb * Nk];
 	unsigned int i;
 
-	/* DECRYPTION: */
-
-	/* formatting the sequence b for decryption: */
-	b[0] = 1; /* q - 1 = 2 - 1 = 1 */
-	for (i = 1; i < 14; ++i) {
-		b[i] = c->nonce[i - 1];
-	}
-	b[14] = b[15] = TC_ZERO_BYTE; /* initial counter value is 0 */
-
-	/* decrypting payload using ctr mode: */
-	ccm_ctr_mode(out, plen - c->mlen, payload, plen - c->mlen, b, c->sched);
-
-	b[14] = b[15] = TC_ZERO_BYTE; /* restoring initial counter value (0) */
-
-	/* encrypting b and restoring the tag from input: */
-	(void) tc_aes_encrypt(b, b, c->sched);
-	for (i = 0; i < c->mlen; ++i) {
-		tag[i] = *(payload + plen - c->mlen + i) ^ b[i];
-	}
-
 	/* VERIFYING THE AUTHENTICATION TAG: */
 
 	/* formatting the sequence b for authentication: */
@@ -247,16 +244,27 @@ int tc_ccm_decryption_verification(uint8_t *out, unsigned int olen,
 	b[15] = (uint8_t)(plen - c->mlen);
 
 	/* computing the authentication tag using cbc-mac: */
-	(void) tc_aes_encrypt(b, b, c->sched);
+	(void) tc_aes_encrypt(tag, b, c->sched);
 	if (alen > 0) {
-		ccm_cbc_mac(b, associated_data, alen, 1, c->sched);
+		ccm_cbc_mac(tag, associated_data, alen, 1, c->sched);
 	}
-	if (plen > 0) {
-		ccm_cbc_mac(b, out, plen - c->mlen, 0, c->sched);
+
+	/* DECRYPTION: */
+
+	/* formatting the sequence b for decryption: */
+	b[0] = 1; /* q - 1 = 2 - 1 = 1 */
+	b[14] = b[15] = TC_ZERO_BYTE; /* initial counter value is 0 */
+
+	/*
+	 * decrypting payload using ctr mode while completing the tag over
+	 * the plaintext:
+	 */
+	if (!ccm_crypt(out, payload, plen - c->mlen, tag, b, 1, c->sched)) {
+		return TC_CRYPTO_FAIL;
 	}
 
 	/* comparing the received tag and the computed one: */
-	if (_compare(b, tag, c->mlen) == 0) {
+	if (_compare(payload + plen - c->mlen, tag, c->mlen) == 0) {
 		return TC_CRYPTO_SUCCESS;
   	} else {
 		/* erase the decrypted buffer in case of mac validation failure: */
@@ -264,3 +272,504 @@ int tc_ccm_decryption_verification(uint8_t *out, unsigned int olen,
 		return TC_CRYPTO_FAIL;
 	}
 }
+
+/**
+ * Increments the counter held by the last q bytes of the counter block.
+ */
+static void ccm_increment(uint8_t *ctr, unsigned int q)
+{
+	unsigned int i;
+
+	for (i = Nb * Nk; i > Nb * Nk - q; ) {
+		if (++ctr[--i] != 0) {
+			break;
+		}
+	}
+}
+
+/**
+ * Encrypts the CBC-MAC block of s if it is full, side by side with the
+ * counter block of s into the keystream block if ks is set.
+ */
+static int ccm_step(TCCcmState_t s, int ks)
+{
+
+	unsigned int first = (s->offset == Nb * Nk) ? 0 : 1;
+	unsigned int last = ks ? 2 : 1;
+
+	if (ks) {
+		(void) _copy(s->blocks + Nb * Nk, Nb * Nk, s->ctr, Nb * Nk);
+	}
+	if (first < last &&
+	    !tc_aes_encrypt_blocks(s->blocks + Nb * Nk * first,
+				   s->blocks + Nb * Nk * first, last - first,
+				   s->sched)) {
+		return TC_CRYPTO_FAIL;
+	}
+	if (s->offset == Nb * Nk) {
+		s->offset = 0;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ccm_init(TCCcmState_t s, const TCCcmMode_t c, unsigned int q,
+		uint64_t alen, uint64_t plen)
+{
+
+	uint8_t *mac;
+	uint64_t a;
+	unsigned int i;
+	unsigned int n;
+
+	/* input sanity check: */
+	if (s == (TCCcmState_t) 0 ||
+	    c == (TCCcmMode_t) 0 ||
+	    q < 2 || q > 8 ||
+	    (q < 8 && (plen >> (8 * q)) != 0)) { /* payload size unsupported */
+		return TC_CRYPTO_FAIL;
+	}
+
+	_set(s, 0, sizeof(*s));
+	s->alen = alen;
+	s->plen = plen;
+	s->q = q;
+	s->mlen = c->mlen;
+	s->sched = c->sched;
+
+	/* formatting the sequence b for authentication: */
+	mac = s->blocks;
+	mac[0] = ((alen > 0) ? 0x40:0) | (((c->mlen - 2) / 2 << 3)) | (q - 1);
+	(void) _copy(mac + 1, Nb * Nk - 1, c->nonce, Nb * Nk - 1 - q);
+	for (i = Nb * Nk, a = plen; i > Nb * Nk - q; a >>= 8) {
+		mac[--i] = (uint8_t)(a);
+	}
+	s->offset = Nb * Nk;
+
+	/* formatting the sequence b for encryption, with counter 0: */
+	s->ctr[0] = (uint8_t)(q - 1);
+	(void) _copy(s->ctr + 1, Nb * Nk - 1, c->nonce, Nb * Nk - 1 - q);
+
+	/* the associated data starts with its length, on 2, 6 or 10 bytes: */
+	if (alen > 0) {
+		if (!ccm_step(s, 0)) {
+			return TC_CRYPTO_FAIL;
+		}
+		if (alen < TC_CCM_AAD_MAX_BYTES) {
+			n = 2;
+		} else {
+			n = ((alen >> 32) == 0) ? 6 : 10;
+			mac[0] ^= 0xff;
+			mac[1] ^= (n == 6) ? 0xfe : 0xff;
+		}
+		for (i = n, a = alen; i > ((n == 2) ? 0 : 2); a >>= 8) {
+			mac[--i] ^= (uint8_t)(a);
+		}
+		s->offset = n;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ccm_update_aad(TCCcmState_t s, const uint8_t *data, size_t len)
+{
+
+	unsigned int n;
+
+	/* input sanity check: */
+	if (s == (TCCcmState_t) 0 ||
+	    (len > 0 && data == (const uint8_t *) 0) ||
+	    len > s->alen) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	while (len > 0) {
+		if (s->offset == Nb * Nk && !ccm_step(s, 0)) {
+			return TC_CRYPTO_FAIL;
+		}
+		n = Nb * Nk - s->offset;
+		if (n > len) {
+			n = (unsigned int) len;
+		}
+		_xor(s->blocks + s->offset, s->blocks + s->offset, data, n);
+		s->offset += n;
+		s->alen -= n;
+		data += n;
+		len -= n;
+	}
+
+	/* the associated data is padded with zeros to a full block: */
+	if (s->alen == 0 && s->offset > 0) {
+		s->offset = Nb * Nk;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+/**
+ * Streaming counterpart of ccm_crypt: a new keystream block is generated
+ * side by side with the CBC-MAC block of the previous payload block.
+ */
+static int ccm_update(TCCcmState_t s, uint8_t *out, const uint8_t *in,
+		      size_t len, int decrypt)
+{
+
+	uint8_t *mac;
+	unsigned int n;
+
+	/* input sanity check: */
+	if (s == (TCCcmState_t) 0 ||
+	    (len > 0 && (out == (uint8_t *) 0 || in == (const uint8_t *) 0)) ||
+	    s->alen > 0 ||
+	    len > s->plen) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	while (len > 0) {
+		if (s->offset == 0 || s->offset == Nb * Nk) {
+			ccm_increment(s->ctr, s->q);
+			if (!ccm_step(s, 1)) {
+				return TC_CRYPTO_FAIL;
+			}
+		}
+		n = Nb * Nk - s->offset;
+		if (n > len) {
+			n = (unsigned int) len;
+		}
+		mac = s->blocks + s->offset;
+		if (!decrypt) {
+			_xor(mac, mac, in, n);
+		}
+		_xor(out, in, mac + Nb * Nk, n);
+		if (decrypt) {
+			_xor(mac, mac, out, n);
+		}
+		s->offset += n;
+		s->plen -= n;
+		out += n;
+		in += n;
+		len -= n;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ccm_encrypt_update(TCCcmState_t s, uint8_t *out, const uint8_t *in,
+			  size_t len)
+{
+	return ccm_update(s, out, in, len, 0);
+}
+
+int tc_ccm_decrypt_update(TCCcmState_t s, uint8_t *out, const uint8_t *in,
+			  size_t len)
+{
+	return ccm_update(s, out, in, len, 1);
+}
+
+/**
+ * Completes the CBC-MAC of s and masks it with the encryption of counter
+ * block 0, leaving the tag at the start of s->blocks.
+ */
+static int ccm_tag(TCCcmState_t s)
+{
+
+	unsigned int i;
+
+	if (s->alen > 0 || s->plen > 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/* the payload is padded with zeros to a full block: */
+	if (s->offset > 0) {
+		s->offset = Nb * Nk;
+	}
+	for (i = Nb * Nk - s->q; i < Nb * Nk; ++i) {
+		s->ctr[i] = TC_ZERO_BYTE;
+	}
+	if (!ccm_step(s, 1)) {
+		return TC_CRYPTO_FAIL;
+	}
+	_xor(s->blocks, s->blocks, s->blocks + Nb * Nk, Nb * Nk);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ccm_final(uint8_t *tag, TCCcmState_t s)
+{
+
+	int r;
+
+	/* input sanity check: */
+	if (tag == (uint8_t *) 0 ||
+	    s == (TCCcmState_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	r = ccm_tag(s);
+	if (r) {
+		(void) _copy(tag, s->mlen, s->blocks, s->mlen);
+	}
+	_set_secure(s, 0, sizeof(*s));
+
+	return r;
+}
+
+int tc_ccm_verify(const uint8_t *tag, TCCcmState_t s)
+{
+
+	int r;
+
+	/* input sanity check: */
+	if (tag == (const uint8_t *) 0 ||
+	    s == (TCCcmState_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	r = ccm_tag(s) && _compare(tag, s->blocks, s->mlen) == 0;
+	_set_secure(s, 0, sizeof(*s));
+
+	return r ? TC_CRYPTO_SUCCESS : TC_CRYPTO_FAIL;
+}
+
+/* number of packets of a CCM batch processed side by side */
+#define CCM_BATCH_LANES (2 * TC_AES_PARALLEL_BLOCKS)
+
+/*
+ * A packet of a CCM batch being processed: each step encrypts its next
+ * CBC-MAC block, side by side with the counter block of the payload block
+ * after the one that CBC-MAC block covers, so that the keystream of a
+ * payload block is ready one step before the block is authenticated.
+ */
+struct ccm_lane {
+	TCCcmPacket_t p;
+	unsigned int plen; /* payload length in bytes, without the tag */
+	unsigned int naad; /* index of the first CBC-MAC block of payload */
+	unsigned int nmac; /* number of CBC-MAC blocks */
+	unsigned int step; /* index of the next CBC-MAC block */
+	int ctr; /* counter of the block encrypted this step, or -1 */
+	int s0; /* whether counter block 0 has been encrypted */
+	uint8_t T[Nb * Nk]; /* CBC-MAC */
+	uint8_t ks[Nb * Nk]; /* keystream of the next payload block */
+	uint8_t tag[Nb * Nk]; /* encrypted counter block 0 */
+};
+
+/**
+ * Checks a packet of a CCM batch as the one-shot procedures check their
+ * input.
+ */
+static int ccm_packet_check(const TCCcmPacket_t p, unsigned int mlen,
+			    int decrypt)
+{
+
+	unsigned int plen = p->plen;
+
+	if (decrypt) {
+		if (plen < mlen) {
+			return TC_CRYPTO_FAIL;
+		}
+		plen -= mlen;
+	}
+
+	if ((p->out == (uint8_t *) 0) ||
+	    (p->nonce == (const uint8_t *) 0) ||
+	    ((p->plen > 0) && (p->payload == (const uint8_t *) 0)) ||
+	    ((p->alen > 0) && (p->associated_data == (const uint8_t *) 0)) ||
+	    (p->alen >= TC_CCM_AAD_MAX_BYTES) ||
+	    (p->plen >= TC_CCM_PAYLOAD_MAX_BYTES) ||
+	    (p->olen < plen + (decrypt ? 0 : mlen))) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+/**
+ * Lays out the next CBC-MAC block of a lane in mac, and the counter block
+ * to encrypt alongside, if any, in ctr; returns the number of blocks.
+ */
+static unsigned int ccm_lane_blocks(struct ccm_lane *l, uint8_t *mac,
+				    uint8_t *ctr, unsigned int mlen,
+				    int decrypt)
+{
+
+	const TCCcmPacket_t p = l->p;
+	unsigned int nblocks = (l->plen + Nb * Nk - 1) / (Nb * Nk);
+	unsigned int off;
+	unsigned int len;
+	unsigned int i;
+	int c;
+
+	if (l->step == 0) {
+		/* formatting the sequence b for authentication: */
+		mac[0] = ((p->alen > 0) ? 0x40:0) | (((mlen - 2) / 2 << 3)) | (1);
+		(void) _copy(mac + 1, Nb * Nk - 1, p->nonce, 13);
+		mac[14] = (uint8_t)(l->plen >> 8);
+		mac[15] = (uint8_t)(l->plen);
+	} else if (l->step < l->naad) {
+		/* associated data, following its length: */
+		(void) _copy(mac, Nb * Nk, l->T, Nb * Nk);
+		if (l->step == 1) {
+			mac[0] ^= (uint8_t)(p->alen >> 8);
+			mac[1] ^= (uint8_t)(p->alen);
+			off = 0;
+			i = 2;
+		} else {
+			off = Nb * Nk * (l->step - 1) - 2;
+			i = 0;
+		}
+		len = (p->alen - off < Nb * Nk - i) ? p->alen - off : Nb * Nk - i;
+		_xor(mac + i, mac + i, p->associated_data + off, len);
+	} else {
+		/* payload, which is encrypted (or decrypted) on the way: */
+		(void) _copy(mac, Nb * Nk, l->T, Nb * Nk);
+		off = Nb * Nk * (l->step - l->naad);
+		len = (l->plen - off < Nb * Nk) ? l->plen - off : Nb * Nk;
+		if (!decrypt) {
+			_xor(mac, mac, p->payload + off, len);
+		}
+		_xor(p->out + off, p->payload + off, l->ks, len);
+		if (decrypt) {
+			_xor(mac, mac, p->out + off, len);
+		}
+	}
+
+	/*
+	 * the counter of the payload block after the one the CBC-MAC block
+	 * covers, or counter 0 at the first or last step with none left
+	 */
+	c = (int) (l->step + 2) - (int) l->naad;
+	if (c < 1 || c > (int) nblocks) {
+		c = (!l->s0 && (c < 1 || c == (int) nblocks + 1)) ? 0 : -1;
+	}
+	l->ctr = c;
+	if (c < 0) {
+		return 1;
+	}
+	ctr[0] = 1; /* q - 1 = 2 - 1 = 1 */
+	(void) _copy(ctr + 1, Nb * Nk - 1, p->nonce, 13);
+	ctr[14] = (uint8_t)(c >> 8);
+	ctr[15] = (uint8_t)(c);
+
+	return 2;
+}
+
+/**
+ * Seals or opens the packets of a CCM batch, CCM_BATCH_LANES at a time: the
+ * lane of a finished packet is handed to the next packet of the batch.
+ */
+static int ccm_batch(TCCcmPacket_t packets, unsigned int npackets,
+		     const TCCcmMode_t c, int decrypt)
+{
+
+	struct ccm_lane lanes[CCM_BATCH_LANES];
+	uint8_t buffer[2 * CCM_BATCH_LANES * Nb * Nk];
+	unsigned int slot[CCM_BATCH_LANES];
+	unsigned int j, k, n, nb;
+	int result = TC_CRYPTO_SUCCESS;
+	struct ccm_lane *l;
+
+	/* input sanity check: */
+	if (packets == (TCCcmPacket_t) 0 ||
+	    c == (TCCcmMode_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	j = 0;
+	n = 0;
+	for (;;) {
+		for (k = 0; k < n; ) {
+			if (lanes[k].step == lanes[k].nmac) {
+				lanes[k] = lanes[--n];
+			} else {
+				++k;
+			}
+		}
+		for (; j < npackets && n < CCM_BATCH_LANES; ++j) {
+			if (!ccm_packet_check(&packets[j], c->mlen, decrypt)) {
+				packets[j].status = TC_CRYPTO_FAIL;
+				result = TC_CRYPTO_FAIL;
+				continue;
+			}
+			l = &lanes[n++];
+			l->p = &packets[j];
+			l->plen = packets[j].plen - (decrypt ? c->mlen : 0);
+			l->naad = 1;
+			if (packets[j].alen > 0) {
+				l->naad += (packets[j].alen + 2 + Nb * Nk - 1) /
+					   (Nb * Nk);
+			}
+			l->nmac = l->naad +
+				  (l->plen + Nb * Nk - 1) / (Nb * Nk);
+			l->step = 0;
+			l->s0 = 0;
+		}
+		if (n == 0) {
+			break;
+		}
+
+		/* lay out the blocks of every packet */
+		nb = 0;
+		for (k = 0; k < n; ++k) {
+			slot[k] = nb;
+			nb += ccm_lane_blocks(&lanes[k], buffer + Nb * Nk * nb,
+					      buffer + Nb * Nk * (nb + 1),
+					      c->mlen, decrypt);
+		}
+
+		/* encrypt them all at once */
+		if (!tc_aes_encrypt_blocks(buffer, buffer, nb, c->sched)) {
+			return TC_CRYPTO_FAIL;
+		}
+
+		for (k = 0; k < n; ++k) {
+			l = &lanes[k];
+			(void) _copy(l->T, Nb * Nk, buffer + Nb * Nk * slot[k],
+				     Nb * Nk);
+			if (l->ctr > 0) {
+				(void) _copy(l->ks, Nb * Nk,
+					     buffer + Nb * Nk * (slot[k] + 1),
+					     Nb * Nk);
+			} else if (l->ctr == 0) {
+				(void) _copy(l->tag, Nb * Nk,
+					     buffer + Nb * Nk * (slot[k] + 1),
+					     Nb * Nk);
+				l->s0 = 1;
+			}
+			if (++l->step < l->nmac) {
+				continue;
+			}
+
+			/* the packet is complete: mask its tag */
+			_xor(l->tag, l->tag, l->T, Nb * Nk);
+			l->p->status = TC_CRYPTO_SUCCESS;
+			if (!decrypt) {
+				(void) _copy(l->p->out + l->plen, c->mlen,
+					     l->tag, c->mlen);
+			} else if (_compare(l->p->payload + l->plen, l->tag,
+					    c->mlen) != 0) {
+				/* erase the decrypted buffer: */
+				_set(l->p->out, 0, l->plen);
+				l->p->status = TC_CRYPTO_FAIL;
+				result = TC_CRYPTO_FAIL;
+			}
+		}
+	}
+
+	/* zeroing out the keystream */
+	_set(buffer, 0, sizeof(buffer));
+	_set(lanes, 0, sizeof(lanes));
+
+	return result;
+}
+
+int tc_ccm_seal_batch(TCCcmPacket_t packets, unsigned int npackets,
+		      const TCCcmMode_t c)
+{
+	return ccm_batch(packets, npackets, c, 0);
+}
+
+int tc_ccm_open_batch(TCCcmPacket_t packets, unsigned int npackets,
+		      const TCCcmMode_t c)
+{
+	return ccm_batch(packets, npackets, c, 1);
+}
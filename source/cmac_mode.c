@@ -94,6 +94,28 @@ void gf_double(uint8_t *out, uint8_t *in)
 	}
 }
 
+int tc_cmac_subkeys(uint8_t *K1, uint8_t *K2, const TCAesKeySched_t sched)
+{
+	uint8_t L[TC_AES_BLOCK_SIZE];
+
+	/* input sanity check: */
+	if (K1 == (uint8_t *) 0 ||
+	    K2 == (uint8_t *) 0 ||
+	    sched == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/* compute K1 and K2 from the encryption of the all zero block */
+	_set(L, 0, TC_AES_BLOCK_SIZE);
+	tc_aes_encrypt(L, L, sched);
+	gf_double (K1, L);
+	gf_double (K2, K1);
+
+	_set_secure(L, 0, TC_AES_BLOCK_SIZE);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
 int tc_cmac_setup(TCCmacState_t s, const uint8_t *key, TCAesKeySched_t sched)
 {
 
@@ -110,11 +132,8 @@ int tc_cmac_setup(TCCmacState_t s, const uint8_t *key, TCAesKeySched_t sched)
 	/* configure the encryption key used by the underlying block cipher */
 	tc_aes128_set_encrypt_key(s->sched, key);
 
-	/* compute s->K1 and s->K2 from s->iv using s->keyid */
-	_set(s->iv, 0, TC_AES_BLOCK_SIZE);
-	tc_aes_encrypt(s->iv, s->iv, s->sched);
-	gf_double (s->K1, s->iv);
-	gf_double (s->K2, s->K1);
+	/* compute s->K1 and s->K2 */
+	tc_cmac_subkeys(s->K1, s->K2, s->sched);
 
 	/* reset s->iv to 0 in case someone wants to compute now */
 	tc_cmac_init(s);
@@ -122,6 +141,30 @@ int tc_cmac_setup(TCCmacState_t s, const uint8_t *key, TCAesKeySched_t sched)
 	return TC_CRYPTO_SUCCESS;
 }
 
+int tc_cmac_setup_subkeys(TCCmacState_t s, const uint8_t *K1,
+			  const uint8_t *K2, TCAesKeySched_t sched)
+{
+
+	/* input sanity check: */
+	if (s == (TCCmacState_t) 0 ||
+	    K1 == (const uint8_t *) 0 ||
+	    K2 == (const uint8_t *) 0 ||
+	    sched == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/* put s into a known state */
+	_set(s, 0, sizeof(*s));
+	s->sched = sched;
+
+	(void)_copy(s->K1, TC_AES_BLOCK_SIZE, K1, TC_AES_BLOCK_SIZE);
+	(void)_copy(s->K2, TC_AES_BLOCK_SIZE, K2, TC_AES_BLOCK_SIZE);
+
+	tc_cmac_init(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
 int tc_cmac_erase(TCCmacState_t s)
 {
 	if (s == (TCCmacState_t) 0) {
@@ -179,8 +222,11 @@ int tc_cmac_update(TCCmacState_t s, const uint8_t *data, size_t data_length)
 		/* last data added to s didn't end on a TC_AES_BLOCK_SIZE byte boundary */
 		size_t remaining_space = TC_AES_BLOCK_SIZE - s->leftover_offset;
 
-		if (data_length < remaining_space) {
-			/* still not enough data to encrypt this time either */
+		if (data_length <= remaining_space) {
+			/*
+			 * still not enough data to encrypt this time either: a
+			 * full block may be the last one, which takes K1
+			 */
 			_copy(&s->leftover[s->leftover_offset], data_length, data, data_length);
 			s->leftover_offset += data_length;
 			return TC_CRYPTO_SUCCESS;
@@ -219,17 +265,16 @@ int tc_cmac_update(TCCmacState_t s, const uint8_t *data, size_t data_length)
 	return TC_CRYPTO_SUCCESS;
 }
 
-int tc_cmac_final(uint8_t *tag, TCCmacState_t s)
+/*
+ *  assumes: s != NULL and holds the last block of a message in leftover.
+ *  effects: mixes the last block, padded or not, and its subkey into the
+ *           CBC-MAC of s, which is then ready to be encrypted into the tag.
+ */
+static void cmac_last_block(TCCmacState_t s)
 {
 	uint8_t *k;
 	unsigned int i;
 
-	/* input sanity check: */
-	if (tag == (uint8_t *) 0 ||
-	    s == (TCCmacState_t) 0) {
-		return TC_CRYPTO_FAIL;
-	}
-
 	if (s->leftover_offset == TC_AES_BLOCK_SIZE) {
 		/* the last message block is a full-sized block */
 		k = (uint8_t *) s->K1;
@@ -244,6 +289,18 @@ int tc_cmac_final(uint8_t *tag, TCCmacState_t s)
 	for (i = 0; i < TC_AES_BLOCK_SIZE; ++i) {
 		s->iv[i] ^= s->leftover[i] ^ k[i];
 	}
+}
+
+int tc_cmac_final(uint8_t *tag, TCCmacState_t s)
+{
+
+	/* input sanity check: */
+	if (tag == (uint8_t *) 0 ||
+	    s == (TCCmacState_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	cmac_last_block(s);
 
 	tc_aes_encrypt(tag, s->iv, s->sched);
 
@@ -252,3 +309,143 @@ int tc_cmac_final(uint8_t *tag, TCCmacState_t s)
 
 	return TC_CRYPTO_SUCCESS;
 }
+
+/* number of messages tc_cmac_update_multi advances side by side */
+#define CMAC_MULTI_LANES (4 * TC_AES_PARALLEL_BLOCKS)
+
+/*
+ *  assumes: job != NULL and *offset bytes of its data have been mixed.
+ *  effects: copies the data of job that follows into the leftover block of
+ *           its state, until the block is full; returns whether that block
+ *           has to be encrypted before the rest of the data is copied, that
+ *           is, whether it is full and not the last one of the data.
+ */
+static int cmac_absorb(const TCCmacJob_t job, size_t *offset)
+{
+	TCCmacState_t s = job->s;
+	size_t n = job->len - *offset;
+
+	if (n > TC_AES_BLOCK_SIZE - s->leftover_offset) {
+		n = TC_AES_BLOCK_SIZE - s->leftover_offset;
+	}
+	(void)_copy(&s->leftover[s->leftover_offset], n,
+		    job->data + *offset, n);
+	s->leftover_offset += n;
+	*offset += n;
+
+	return s->leftover_offset == TC_AES_BLOCK_SIZE && *offset < job->len;
+}
+
+int tc_cmac_update_multi(const TCCmacJob_t jobs, unsigned int njobs)
+{
+	struct tc_aes_job_struct aes[CMAC_MULTI_LANES];
+	size_t offset[CMAC_MULTI_LANES];
+	unsigned int msg[CMAC_MULTI_LANES];
+	unsigned int j, k, n;
+	TCCmacState_t s;
+
+	/* input sanity check: */
+	if (jobs == (TCCmacJob_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+	for (j = 0; j < njobs; ++j) {
+		if (jobs[j].s == (TCCmacState_t) 0 ||
+		    (jobs[j].len > 0 &&
+		     (jobs[j].data == (const uint8_t *) 0 ||
+		      jobs[j].s->countdown == 0))) {
+			return TC_CRYPTO_FAIL;
+		}
+	}
+
+	/*
+	 * Each lane carries a message, one block per step; the lane of a
+	 * finished message is handed to the next message of the batch.
+	 */
+	j = 0;
+	n = 0;
+	for (;;) {
+		for (; j < njobs && n < CMAC_MULTI_LANES; ++j) {
+			if (jobs[j].len == 0) {
+				continue;
+			}
+			jobs[j].s->countdown--;
+			offset[n] = 0;
+			if (cmac_absorb(&jobs[j], &offset[n])) {
+				msg[n++] = j;
+			}
+		}
+		if (n == 0) {
+			break;
+		}
+
+		/* chain the leftover block of every message */
+		for (k = 0; k < n; ++k) {
+			s = jobs[msg[k]].s;
+			_xor(s->iv, s->iv, s->leftover, TC_AES_BLOCK_SIZE);
+			s->leftover_offset = 0;
+			aes[k].sched = s->sched;
+			aes[k].in = s->iv;
+			aes[k].out = s->iv;
+			aes[k].nblocks = 1;
+		}
+
+		/* encrypt them all at once */
+		if (!tc_aes_encrypt_jobs(aes, n)) {
+			return TC_CRYPTO_FAIL;
+		}
+
+		/* refill the leftover blocks, releasing the finished lanes */
+		for (k = 0; k < n; ) {
+			if (cmac_absorb(&jobs[msg[k]], &offset[k])) {
+				++k;
+			} else {
+				msg[k] = msg[--n];
+				offset[k] = offset[n];
+			}
+		}
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_cmac_final_multi(uint8_t *tags, const TCCmacState_t *states,
+			unsigned int nstates)
+{
+	struct tc_aes_job_struct aes[CMAC_MULTI_LANES];
+	unsigned int j, k, n;
+
+	/* input sanity check: */
+	if (tags == (uint8_t *) 0 ||
+	    states == (const TCCmacState_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+	for (j = 0; j < nstates; ++j) {
+		if (states[j] == (TCCmacState_t) 0) {
+			return TC_CRYPTO_FAIL;
+		}
+	}
+
+	for (j = 0; j < nstates; j += n) {
+		n = nstates - j;
+		if (n > CMAC_MULTI_LANES) {
+			n = CMAC_MULTI_LANES;
+		}
+		for (k = 0; k < n; ++k) {
+			cmac_last_block(states[j + k]);
+			aes[k].sched = states[j + k]->sched;
+			aes[k].in = states[j + k]->iv;
+			aes[k].out = tags + TC_AES_BLOCK_SIZE * (j + k);
+			aes[k].nblocks = 1;
+		}
+		if (!tc_aes_encrypt_jobs(aes, n)) {
+			return TC_CRYPTO_FAIL;
+		}
+
+		/* erasing states: */
+		for (k = 0; k < n; ++k) {
+			tc_cmac_erase(states[j + k]);
+		}
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
@@ -34,14 +34,53 @@
 #include <tinycrypt/ctr_mode.h>
 #include <tinycrypt/utils.h>
 
+/* width in bytes of the counter of tc_ctr_mode */
+#define CTR_WIDTH 4
+
+/*
+ * Lays out the next n counter blocks of ctr in buffer, advancing the
+ * counter held by the last width bytes of ctr past them.
+ */
+static void ctr_blocks(uint8_t *buffer, unsigned int n, uint8_t *ctr,
+		       unsigned int width)
+{
+	unsigned int i;
+
+	for (; n > 0; --n, buffer += TC_AES_BLOCK_SIZE) {
+		(void)_copy(buffer, TC_AES_BLOCK_SIZE, ctr, TC_AES_BLOCK_SIZE);
+		/* big-endian increment, the carry wrapping within width bytes */
+		for (i = TC_AES_BLOCK_SIZE; i > TC_AES_BLOCK_SIZE - width; ) {
+			if (++ctr[--i] != 0) {
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Adds n to the counter held by the last width bytes of ctr, the carry
+ * wrapping within width bytes.
+ */
+static void ctr_add(uint8_t *ctr, uint64_t n, unsigned int width)
+{
+	unsigned int carry = 0;
+	unsigned int i;
+
+	for (i = TC_AES_BLOCK_SIZE; i > TC_AES_BLOCK_SIZE - width; n >>= 8) {
+		--i;
+		carry += ctr[i] + (unsigned int)(n & 0xff);
+		ctr[i] = (uint8_t) carry;
+		carry >>= 8;
+	}
+}
+
 int tc_ctr_mode(uint8_t *out, unsigned int outlen, const uint8_t *in,
 		unsigned int inlen, uint8_t *ctr, const TCAesKeySched_t sched)
 {
 
-	uint8_t buffer[TC_AES_BLOCK_SIZE];
-	uint8_t nonce[TC_AES_BLOCK_SIZE];
-	unsigned int block_num;
-	unsigned int i;
+	uint8_t buffer[TC_AES_PARALLEL_BLOCKS * TC_AES_BLOCK_SIZE];
+	unsigned int nblocks;
+	unsigned int blen;
 
 	/* input sanity check: */
 	if (out == (uint8_t *) 0 ||
@@ -54,32 +93,375 @@ int tc_ctr_mode(uint8_t *out, unsigned int outlen, const uint8_t *in,
 		return TC_CRYPTO_FAIL;
 	}
 
-	/* copy the ctr to the nonce */
-	(void)_copy(nonce, sizeof(nonce), ctr, sizeof(nonce));
-
-	/* select the last 4 bytes of the nonce to be incremented */
-	block_num = (nonce[12] << 24) | (nonce[13] << 16) |
-		    (nonce[14] << 8) | (nonce[15]);
-	for (i = 0; i < inlen; ++i) {
-		if ((i % (TC_AES_BLOCK_SIZE)) == 0) {
-			/* encrypt data using the current nonce */
-			if (tc_aes_encrypt(buffer, nonce, sched)) {
-				block_num++;
-				nonce[12] = (uint8_t)(block_num >> 24);
-				nonce[13] = (uint8_t)(block_num >> 16);
-				nonce[14] = (uint8_t)(block_num >> 8);
-				nonce[15] = (uint8_t)(block_num);
-			} else {
-				return TC_CRYPTO_FAIL;
-			}
+	while (inlen > 0) {
+		/* lay out the counter blocks of the next batch */
+		nblocks = (inlen + TC_AES_BLOCK_SIZE - 1) / TC_AES_BLOCK_SIZE;
+		if (nblocks > TC_AES_PARALLEL_BLOCKS) {
+			nblocks = TC_AES_PARALLEL_BLOCKS;
 		}
+		ctr_blocks(buffer, nblocks, ctr, CTR_WIDTH);
+
+		/* encrypt them all at once */
+		if (!tc_aes_encrypt_blocks(buffer, buffer, nblocks, sched)) {
+			return TC_CRYPTO_FAIL;
+		}
+
 		/* update the output */
-		*out++ = buffer[i%(TC_AES_BLOCK_SIZE)] ^ *in++;
+		blen = (inlen < sizeof(buffer)) ? inlen : sizeof(buffer);
+		_xor(out, in, buffer, blen);
+		out += blen;
+		in += blen;
+		inlen -= blen;
+	}
+
+	/* zeroing out the keystream */
+	_set(buffer, 0, sizeof(buffer));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+/* number of counter blocks laid out per step of tc_ctr_mode_multi */
+#define CTR_MULTI_BLOCKS (4 * TC_AES_PARALLEL_BLOCKS)
+
+int tc_ctr_mode_multi(const TCCtrJob_t jobs, unsigned int njobs)
+{
+	struct tc_aes_job_struct aes[CTR_MULTI_BLOCKS];
+	uint8_t buffer[CTR_MULTI_BLOCKS * TC_AES_BLOCK_SIZE];
+	unsigned int offset[CTR_MULTI_BLOCKS];
+	unsigned int msg[CTR_MULTI_BLOCKS];
+	unsigned int j, off, n, e, k, nb, blen;
+	const uint8_t *in;
+	uint8_t *out;
+	uint8_t *ks;
+
+	/* input sanity check: */
+	if (jobs == (TCCtrJob_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+	for (j = 0; j < njobs; ++j) {
+		if (jobs[j].out == (uint8_t *) 0 ||
+		    jobs[j].in == (const uint8_t *) 0 ||
+		    jobs[j].ctr == (uint8_t *) 0 ||
+		    jobs[j].sched == (TCAesKeySched_t) 0) {
+			return TC_CRYPTO_FAIL;
+		}
+	}
+
+	j = 0;
+	off = 0;
+	while (j < njobs) {
+		/*
+		 * lay out the counter blocks of the messages from byte off of
+		 * message j on, one entry of the batch per message
+		 */
+		n = 0;
+		e = 0;
+		for (; j < njobs && n < CTR_MULTI_BLOCKS; ++j, off = 0) {
+			nb = (jobs[j].len - off + TC_AES_BLOCK_SIZE - 1) /
+			     TC_AES_BLOCK_SIZE;
+			if (nb == 0) {
+				continue;
+			}
+			if (nb > CTR_MULTI_BLOCKS - n) {
+				nb = CTR_MULTI_BLOCKS - n;
+			}
+			ks = buffer + TC_AES_BLOCK_SIZE * n;
+			ctr_blocks(ks, nb, jobs[j].ctr, CTR_WIDTH);
+			aes[e].sched = jobs[j].sched;
+			aes[e].in = ks;
+			aes[e].out = ks;
+			aes[e].nblocks = nb;
+			msg[e] = j;
+			offset[e++] = off;
+			n += nb;
+			if (off + TC_AES_BLOCK_SIZE * nb < jobs[j].len) {
+				off += TC_AES_BLOCK_SIZE * nb;
+				break;
+			}
+		}
+
+		/* encrypt them all at once */
+		if (!tc_aes_encrypt_jobs(aes, e)) {
+			return TC_CRYPTO_FAIL;
+		}
+
+		/* update the outputs */
+		for (k = 0; k < e; ++k) {
+			in = jobs[msg[k]].in + offset[k];
+			out = jobs[msg[k]].out + offset[k];
+			blen = jobs[msg[k]].len - offset[k];
+			if (blen > TC_AES_BLOCK_SIZE * aes[k].nblocks) {
+				blen = TC_AES_BLOCK_SIZE * aes[k].nblocks;
+			}
+			_xor(out, in, aes[k].out, blen);
+		}
+	}
+
+	/* zeroing out the keystream */
+	_set(buffer, 0, sizeof(buffer));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ctr_init(TCCtrState_t s, const uint8_t *ctr, unsigned int width,
+		const TCAesKeySched_t sched)
+{
+
+	/* input sanity check: */
+	if (s == (TCCtrState_t) 0 ||
+	    ctr == (const uint8_t *) 0 ||
+	    sched == (TCAesKeySched_t) 0 ||
+	    (width != 32 && width != 64 && width != 128)) {
+		return TC_CRYPTO_FAIL;
 	}
 
-	/* update the counter */
-	ctr[12] = nonce[12]; ctr[13] = nonce[13];
-	ctr[14] = nonce[14]; ctr[15] = nonce[15];
+	_set(s, 0, sizeof(*s));
+	(void)_copy(s->base, sizeof(s->base), ctr, TC_AES_BLOCK_SIZE);
+	(void)_copy(s->ctr, sizeof(s->ctr), ctr, TC_AES_BLOCK_SIZE);
+	s->width = width / 8;
+	s->sched = sched;
 
 	return TC_CRYPTO_SUCCESS;
 }
+
+int tc_ctr_update(TCCtrState_t s, uint8_t *out, const uint8_t *in,
+		  size_t len)
+{
+	uint8_t buffer[TC_AES_PARALLEL_BLOCKS * TC_AES_BLOCK_SIZE];
+	unsigned int nblocks;
+	unsigned int blen;
+
+	/* input sanity check: */
+	if (s == (TCCtrState_t) 0 ||
+	    (len > 0 && (out == (uint8_t *) 0 || in == (const uint8_t *) 0))) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/* first use up the keystream left over by the previous chunk */
+	if (s->leftover > 0) {
+		blen = (len < s->leftover) ? (unsigned int) len : s->leftover;
+		_xor(out, in, &s->keystream[TC_AES_BLOCK_SIZE - s->leftover],
+		     blen);
+		s->leftover -= blen;
+		out += blen;
+		in += blen;
+		len -= blen;
+	}
+
+	while (len > 0) {
+		blen = (len < sizeof(buffer)) ? (unsigned int) len :
+						sizeof(buffer);
+		nblocks = (blen + TC_AES_BLOCK_SIZE - 1) / TC_AES_BLOCK_SIZE;
+		ctr_blocks(buffer, nblocks, s->ctr, s->width);
+		if (!tc_aes_encrypt_blocks(buffer, buffer, nblocks, s->sched)) {
+			return TC_CRYPTO_FAIL;
+		}
+		_xor(out, in, buffer, blen);
+		out += blen;
+		in += blen;
+		len -= blen;
+
+		/* keep the unused keystream of a final partial block */
+		s->leftover = nblocks * TC_AES_BLOCK_SIZE - blen;
+		if (s->leftover > 0) {
+			(void)_copy(s->keystream, sizeof(s->keystream),
+				    &buffer[blen - blen % TC_AES_BLOCK_SIZE],
+				    TC_AES_BLOCK_SIZE);
+		}
+	}
+
+	/* zeroing out the keystream */
+	_set(buffer, 0, sizeof(buffer));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ctr_seek(TCCtrState_t s, uint64_t offset)
+{
+	unsigned int skip = (unsigned int)(offset % TC_AES_BLOCK_SIZE);
+
+	/* input sanity check: */
+	if (s == (TCCtrState_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	(void)_copy(s->ctr, sizeof(s->ctr), s->base, sizeof(s->base));
+	ctr_add(s->ctr, offset / TC_AES_BLOCK_SIZE, s->width);
+	s->leftover = 0;
+
+	/* an offset within a block leaves the rest of its keystream over */
+	if (skip > 0) {
+		if (!tc_aes_encrypt(s->keystream, s->ctr, s->sched)) {
+			return TC_CRYPTO_FAIL;
+		}
+		ctr_add(s->ctr, 1, s->width);
+		s->leftover = TC_AES_BLOCK_SIZE - skip;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ctr_final(uint8_t *ctr, TCCtrState_t s)
+{
+
+	/* input sanity check: */
+	if (s == (TCCtrState_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	if (ctr != (uint8_t *) 0) {
+		(void)_copy(ctr, TC_AES_BLOCK_SIZE, s->ctr, sizeof(s->ctr));
+	}
+	_set_secure(s, 0, sizeof(*s));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ctr_prefetch_init(TCCtrPrefetch_t p, uint8_t *ring, unsigned int size,
+			 const uint8_t *ctr, unsigned int width,
+			 const TCAesKeySched_t sched)
+{
+
+	/* input sanity check: */
+	if (p == (TCCtrPrefetch_t) 0 ||
+	    ring == (uint8_t *) 0 ||
+	    size < TC_AES_BLOCK_SIZE) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	_set(p, 0, sizeof(*p));
+	p->ring = ring;
+	p->size = size - size % TC_AES_BLOCK_SIZE;
+
+	return tc_ctr_init(&p->ctr, ctr, width, sched);
+}
+
+/*
+ * The keystream in the ring always ends on a block boundary, since it is
+ * generated in whole blocks, so that the free space after it is made of
+ * whole blocks too. The keystream of a partial block left over by an
+ * inline fallback is only found while the ring is empty; filling moves it
+ * into the ring first, to keep the keystream in order.
+ */
+int tc_ctr_prefetch_fill(TCCtrPrefetch_t p, unsigned int max)
+{
+	unsigned int tail;
+	unsigned int n;
+
+	/* input sanity check: */
+	if (p == (TCCtrPrefetch_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	if (p->ctr.leftover > 0) {
+		(void)_copy(p->ring, p->size, p->ctr.keystream,
+			    TC_AES_BLOCK_SIZE);
+		p->head = TC_AES_BLOCK_SIZE - p->ctr.leftover;
+		p->fill = p->ctr.leftover;
+		p->ctr.leftover = 0;
+	}
+
+	while (max > 0 && p->size - p->fill >= TC_AES_BLOCK_SIZE) {
+		/* generate up to the end of the ring, then wrap around */
+		tail = (p->head + p->fill) % p->size;
+		n = (p->size - p->fill) / TC_AES_BLOCK_SIZE;
+		if (n > (p->size - tail) / TC_AES_BLOCK_SIZE) {
+			n = (p->size - tail) / TC_AES_BLOCK_SIZE;
+		}
+		if (n > (max + TC_AES_BLOCK_SIZE - 1) / TC_AES_BLOCK_SIZE) {
+			n = (max + TC_AES_BLOCK_SIZE - 1) / TC_AES_BLOCK_SIZE;
+		}
+
+		ctr_blocks(&p->ring[tail], n, p->ctr.ctr, p->ctr.width);
+		if (!tc_aes_encrypt_blocks(&p->ring[tail], &p->ring[tail], n,
+					   p->ctr.sched)) {
+			return TC_CRYPTO_FAIL;
+		}
+		p->fill += n * TC_AES_BLOCK_SIZE;
+		max = (max > n * TC_AES_BLOCK_SIZE) ?
+		      max - n * TC_AES_BLOCK_SIZE : 0;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+unsigned int tc_ctr_prefetch_buffered(const TCCtrPrefetch_t p)
+{
+	if (p == (TCCtrPrefetch_t) 0) {
+		return 0;
+	}
+
+	return p->fill + p->ctr.leftover;
+}
+
+int tc_ctr_prefetch_update(TCCtrPrefetch_t p, uint8_t *out,
+			   const uint8_t *in, size_t len)
+{
+	unsigned int n;
+
+	/* input sanity check: */
+	if (p == (TCCtrPrefetch_t) 0 ||
+	    (len > 0 && (out == (uint8_t *) 0 || in == (const uint8_t *) 0))) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/* use the buffered keystream, up to the end of the ring at a time */
+	while (len > 0 && p->fill > 0) {
+		n = p->size - p->head;
+		if (n > p->fill) {
+			n = p->fill;
+		}
+		if (n > len) {
+			n = (unsigned int) len;
+		}
+		_xor(out, in, &p->ring[p->head], n);
+		_set(&p->ring[p->head], 0, n);
+		p->head = (p->head + n) % p->size;
+		p->fill -= n;
+		out += n;
+		in += n;
+		len -= n;
+	}
+
+	/* the ring ran dry: generate the rest inline */
+	return tc_ctr_update(&p->ctr, out, in, len);
+}
+
+int tc_ctr_prefetch_final(TCCtrPrefetch_t p)
+{
+
+	/* input sanity check: */
+	if (p == (TCCtrPrefetch_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	_set_secure(p->ring, 0, p->size);
+	_set_secure(p, 0, sizeof(*p));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_ctr_mode_at(uint8_t *out, unsigned int outlen, const uint8_t *in,
+		   unsigned int inlen, const uint8_t *ctr, unsigned int width,
+		   uint64_t offset, const TCAesKeySched_t sched)
+{
+	struct tc_ctr_struct s;
+	int r;
+
+	/* input sanity check: */
+	if (out == (uint8_t *) 0 ||
+	    in == (uint8_t *) 0 ||
+	    inlen == 0 ||
+	    outlen == 0 ||
+	    outlen != inlen) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	if (!tc_ctr_init(&s, ctr, width, sched)) {
+		return TC_CRYPTO_FAIL;
+	}
+	r = tc_ctr_seek(&s, offset) && tc_ctr_update(&s, out, in, inlen);
+	(void)tc_ctr_final((uint8_t *) 0, &s);
+
+	return r ? TC_CRYPTO_SUCCESS : TC_CRYPTO_FAIL;
+}
@@ -0,0 +1,116 @@
+/* ctr_mode_mt.c - TinyCrypt implementation of CTR mode on several threads */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tinycrypt/constants.h>
+#include <tinycrypt/ctr_mode.h>
+#include <tinycrypt/utils.h>
+
+/* width in bits of the counter of tc_ctr_mode */
+#define CTR_WIDTH_BITS 32
+
+/* a tc_ctr_mode_mt call, split into chunks of chunk bytes */
+struct ctr_mt {
+	uint8_t *out;
+	const uint8_t *in;
+	unsigned int len;
+	unsigned int chunk;
+	const uint8_t *ctr;
+	TCAesKeySched_t sched;
+};
+
+/* processes chunk i, its counter blocks being found from its offset */
+static int ctr_chunk(void *arg, unsigned int i)
+{
+	const struct ctr_mt *c = (const struct ctr_mt *) arg;
+	unsigned int off = i * c->chunk;
+	unsigned int n = c->len - off;
+
+	if (n > c->chunk) {
+		n = c->chunk;
+	}
+
+	return tc_ctr_mode_at(c->out + off, n, c->in + off, n, c->ctr,
+			      CTR_WIDTH_BITS, off, c->sched);
+}
+
+int tc_ctr_mode_mt(uint8_t *out, unsigned int outlen, const uint8_t *in,
+		   unsigned int inlen, uint8_t *ctr,
+		   const TCAesKeySched_t sched, unsigned int chunk,
+		   unsigned int nthreads)
+{
+	struct tc_ctr_struct s;
+	struct ctr_mt c;
+	unsigned int ntasks;
+
+	/* input sanity check: */
+	if (out == (uint8_t *) 0 ||
+	    in == (uint8_t *) 0 ||
+	    ctr == (uint8_t *) 0 ||
+	    sched == (TCAesKeySched_t) 0 ||
+	    inlen == 0 ||
+	    outlen == 0 ||
+	    outlen != inlen) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/* chunks start on block boundaries */
+	if (chunk == 0) {
+		chunk = TC_CTR_MT_CHUNK;
+	}
+	chunk -= chunk % TC_AES_BLOCK_SIZE;
+	if (chunk == 0) {
+		chunk = TC_AES_BLOCK_SIZE;
+	}
+	if (nthreads == 0) {
+		nthreads = TC_CTR_MT_THREADS;
+	}
+
+	c.out = out;
+	c.in = in;
+	c.len = inlen;
+	c.chunk = chunk;
+	c.ctr = ctr;
+	c.sched = sched;
+	ntasks = (inlen - 1) / chunk + 1;
+	if (!_parallel(ctr_chunk, &c, ntasks, nthreads)) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	/* advance ctr past the counter blocks used, as tc_ctr_mode does */
+	if (!tc_ctr_init(&s, ctr, CTR_WIDTH_BITS, sched) ||
+	    !tc_ctr_seek(&s, ((uint64_t) inlen + TC_AES_BLOCK_SIZE - 1) &
+			     ~(uint64_t) (TC_AES_BLOCK_SIZE - 1))) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	return tc_ctr_final(ctr, &s);
+}
@@ -78,26 +78,20 @@ static void tc_ctr_prng_update(TCCtrPrng_t * const ctx, uint8_t const * const pr
 		uint8_t temp[TC_AES_KEY_SIZE + TC_AES_BLOCK_SIZE];
 		unsigned int len = 0U;
 
-		/* 10.2.1.2 step 2 */
+		/* 10.2.1.2 step 2 - seedlen is a whole number of blocks */
 		while (len < sizeof temp) {
-			unsigned int blocklen = sizeof(temp) - len;
-			uint8_t output_block[TC_AES_BLOCK_SIZE];
-
 			/* 10.2.1.2 step 2.1 */
 			arrInc(ctx->V, sizeof ctx->V);
+			memcpy(&(temp[len]), ctx->V, TC_AES_BLOCK_SIZE);
 
-			/* 10.2.1.2 step 2.2 */
-			if (blocklen > TC_AES_BLOCK_SIZE) {
-				blocklen = TC_AES_BLOCK_SIZE;
-			}
-			(void)tc_aes_encrypt(output_block, ctx->V, &ctx->key);
-
-			/* 10.2.1.2 step 2.3/step 3 */
-			memcpy(&(temp[len]), output_block, blocklen);
-
-			len += blocklen;
+			len += TC_AES_BLOCK_SIZE;
 		}
 
+		/* 10.2.1.2 step 2.2/step 2.3/step 3 */
+		(void)tc_aes_encrypt_blocks(temp, temp,
+					    sizeof temp / TC_AES_BLOCK_SIZE,
+					    &ctx->key);
+
 		/* 10.2.1.2 step 4 */
 		if (0 != providedData) {
 			unsigned int i;
@@ -238,18 +232,27 @@ int tc_ctr_prng_generate(TCCtrPrng_t * const ctx,
 			unsigned int len = 0U;      
 			while (len < outlen) {
 				unsigned int blocklen = outlen - len;
-				uint8_t output_block[TC_AES_BLOCK_SIZE];
+				uint8_t output_block[TC_AES_PARALLEL_BLOCKS * TC_AES_BLOCK_SIZE];
+				unsigned int nblocks;
+				unsigned int i;
 
-				/* 10.2.1.5.1 step 4.1 */
-				arrInc(ctx->V, sizeof ctx->V);
+				if (blocklen > sizeof output_block) {
+					blocklen = sizeof output_block;
+				}
+				nblocks = (blocklen + TC_AES_BLOCK_SIZE - 1U) / TC_AES_BLOCK_SIZE;
+
+				/* 10.2.1.5.1 step 4.1, for a batch of blocks */
+				for (i = 0U; i < nblocks; i++) {
+					arrInc(ctx->V, sizeof ctx->V);
+					memcpy(&(output_block[i * TC_AES_BLOCK_SIZE]), ctx->V,
+					       TC_AES_BLOCK_SIZE);
+				}
 
 				/* 10.2.1.5.1 step 4.2 */
-				(void)tc_aes_encrypt(output_block, ctx->V, &ctx->key);
-      
+				(void)tc_aes_encrypt_blocks(output_block, output_block,
+							    nblocks, &ctx->key);
+
 				/* 10.2.1.5.1 step 4.3/step 5 */
-				if (blocklen > TC_AES_BLOCK_SIZE) {
-					blocklen = TC_AES_BLOCK_SIZE;
-				}
 				memcpy(&(out[len]), output_block, blocklen);
 
 				len += blocklen;
@@ -0,0 +1,268 @@
+/* keyring.c - TinyCrypt implementation of a keyring of expanded AES keys */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tinycrypt/keyring.h>
+#include <tinycrypt/cmac_mode.h>
+#include <tinycrypt/constants.h>
+#include <tinycrypt/utils.h>
+
+/*
+ * Lookups and the rewriting of an entry synchronize on its refs word alone:
+ * a lookup counts itself in with an atomic increment and backs off when it
+ * finds WRITING set or the ID changed, while tc_keyring_add and
+ * tc_keyring_remove only rewrite an entry after atomically moving its refs
+ * from 0 to WRITING, and publish the new contents by clearing WRITING.
+ */
+#define WRITING (0x80000000)
+
+static unsigned int set_of(const TCKeyring_t r, unsigned int id)
+{
+	/* multiplicative hashing spreads sequential key IDs over the sets */
+	id *= 0x9e3779b1;
+	return (id ^ (id >> 16)) & r->mask;
+}
+
+static unsigned int ways_of(const TCKeyring_t r)
+{
+	return (r->mask < TC_KEYRING_WAYS) ? r->mask + 1 : TC_KEYRING_WAYS;
+}
+
+static inline TCKeyringEntry_t entry_of(const TCKeyring_t r,
+					unsigned int set, unsigned int way)
+{
+	return &r->entries[(set + way) & r->mask];
+}
+
+/* lookups made since the entry was last looked up or added */
+static inline unsigned int age(TCKeyringEntry_t e, unsigned int now)
+{
+	return now - __atomic_load_n(&e->last, __ATOMIC_RELAXED);
+}
+
+static int claim(TCKeyringEntry_t e)
+{
+	unsigned int expected = 0;
+
+	return __atomic_compare_exchange_n(&e->refs, &expected, WRITING, 0,
+					   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+static void publish(TCKeyringEntry_t e, unsigned int id)
+{
+	__atomic_store_n(&e->id, id, __ATOMIC_RELAXED);
+	(void)__atomic_fetch_sub(&e->refs, WRITING, __ATOMIC_RELEASE);
+}
+
+static void wipe(TCKeyringEntry_t e)
+{
+	__atomic_store_n(&e->id, 0, __ATOMIC_RELAXED);
+	e->flags = 0;
+	_set_secure(&e->enc, 0, sizeof(e->enc));
+	_set_secure(&e->dec, 0, sizeof(e->dec));
+	_set_secure(e->K1, 0, sizeof(e->K1));
+	_set_secure(e->K2, 0, sizeof(e->K2));
+}
+
+static TCKeyringEntry_t find(const TCKeyring_t r, unsigned int id)
+{
+	unsigned int set = set_of(r, id);
+	unsigned int way;
+
+	for (way = 0; way < ways_of(r); ++way) {
+		if (entry_of(r, set, way)->id == id) {
+			return entry_of(r, set, way);
+		}
+	}
+	return (TCKeyringEntry_t) 0;
+}
+
+int tc_keyring_init(TCKeyring_t r, TCKeyringEntry_t entries,
+		    unsigned int nentries)
+{
+	if (r == (TCKeyring_t) 0 ||
+	    entries == (TCKeyringEntry_t) 0 ||
+	    nentries == 0 ||
+	    (nentries & (nentries - 1)) != 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	_set(entries, 0, nentries * sizeof(*entries));
+	r->entries = entries;
+	r->mask = nentries - 1;
+	r->clock = 0;
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_keyring_add(TCKeyring_t r, unsigned int id, const uint8_t *key,
+		   unsigned int keylen, unsigned int flags)
+{
+	int (*set_encrypt_key)(TCAesKeySched_t, const uint8_t *);
+	int (*set_decrypt_key)(TCAesKeySched_t, const uint8_t *);
+	TCKeyringEntry_t e, victim;
+	unsigned int set, way, now;
+	int held, retry;
+
+	if (r == (TCKeyring_t) 0 ||
+	    key == (const uint8_t *) 0 ||
+	    id == 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	if (keylen == TC_AES_KEY_SIZE) {
+		set_encrypt_key = tc_aes128_set_encrypt_key;
+		set_decrypt_key = tc_aes128_set_decrypt_key;
+	} else if (keylen == TC_AES192_KEY_SIZE) {
+		set_encrypt_key = tc_aes192_set_encrypt_key;
+		set_decrypt_key = tc_aes192_set_decrypt_key;
+	} else if (keylen == TC_AES256_KEY_SIZE) {
+		set_encrypt_key = tc_aes256_set_encrypt_key;
+		set_decrypt_key = tc_aes256_set_decrypt_key;
+	} else {
+		return TC_CRYPTO_FAIL;
+	}
+	if (keylen / Nb + 6 > TC_AES_MAX_ROUNDS) {
+		/* the schedules of the entries have no room for the key */
+		return TC_CRYPTO_FAIL;
+	}
+
+	/*
+	 * Use the entry already holding id, otherwise a free entry of its set,
+	 * otherwise the least recently looked up one. Additions and removals
+	 * being serialized, the claim can only be lost to a lookup that
+	 * started holding the entry after the search, in which case the
+	 * search is made once more; the entry holding id is never duplicated,
+	 * so losing it fails right away.
+	 */
+	now = __atomic_add_fetch(&r->clock, 1, __ATOMIC_RELAXED);
+	set = set_of(r, id);
+	for (retry = 1; ; --retry) {
+		victim = find(r, id);
+		held = (victim != (TCKeyringEntry_t) 0);
+		for (way = 0; victim == (TCKeyringEntry_t) 0 &&
+		     way < ways_of(r); ++way) {
+			e = entry_of(r, set, way);
+			if (e->id == 0) {
+				victim = e;
+			}
+		}
+		for (way = 0; victim == (TCKeyringEntry_t) 0 &&
+		     way < ways_of(r); ++way) {
+			e = entry_of(r, set, way);
+			if (__atomic_load_n(&e->refs, __ATOMIC_RELAXED) == 0 &&
+			    (victim == (TCKeyringEntry_t) 0 ||
+			     age(e, now) > age(victim, now))) {
+				victim = e;
+			}
+		}
+
+		if (victim == (TCKeyringEntry_t) 0) {
+			return TC_CRYPTO_FAIL;
+		}
+		if (claim(victim)) {
+			break;
+		}
+		if (held || retry == 0) {
+			return TC_CRYPTO_FAIL;
+		}
+	}
+
+	wipe(victim);
+	(void)set_encrypt_key(&victim->enc, key);
+	if (flags & TC_KEYRING_DECRYPT) {
+		(void)set_decrypt_key(&victim->dec, key);
+	}
+	(void)tc_cmac_subkeys(victim->K1, victim->K2, &victim->enc);
+	victim->flags = flags;
+	victim->last = now;
+	publish(victim, id);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_keyring_remove(TCKeyring_t r, unsigned int id)
+{
+	TCKeyringEntry_t e;
+
+	if (r == (TCKeyring_t) 0 || id == 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	e = find(r, id);
+	if (e == (TCKeyringEntry_t) 0 || !claim(e)) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	wipe(e);
+	publish(e, 0);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+TCKeyringEntry_t tc_keyring_get(TCKeyring_t r, unsigned int id)
+{
+	TCKeyringEntry_t e;
+	unsigned int set, way, refs, now;
+
+	if (r == (TCKeyring_t) 0 || id == 0) {
+		return (TCKeyringEntry_t) 0;
+	}
+
+	set = set_of(r, id);
+	for (way = 0; way < ways_of(r); ++way) {
+		e = entry_of(r, set, way);
+		if (__atomic_load_n(&e->id, __ATOMIC_RELAXED) != id) {
+			continue;
+		}
+
+		refs = __atomic_fetch_add(&e->refs, 1, __ATOMIC_ACQUIRE);
+		if ((refs & WRITING) == 0 &&
+		    __atomic_load_n(&e->id, __ATOMIC_RELAXED) == id) {
+			/* only store when stale, to keep the line shared */
+			now = __atomic_load_n(&r->clock, __ATOMIC_RELAXED);
+			if (__atomic_load_n(&e->last, __ATOMIC_RELAXED) != now) {
+				__atomic_store_n(&e->last, now, __ATOMIC_RELAXED);
+			}
+			return e;
+		}
+		(void)__atomic_fetch_sub(&e->refs, 1, __ATOMIC_RELEASE);
+	}
+
+	return (TCKeyringEntry_t) 0;
+}
+
+void tc_keyring_put(TCKeyringEntry_t e)
+{
+	if (e != (TCKeyringEntry_t) 0) {
+		(void)__atomic_fetch_sub(&e->refs, 1, __ATOMIC_RELEASE);
+	}
+}
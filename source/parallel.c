@@ -0,0 +1,118 @@
+/* parallel.c - TinyCrypt implementation of a pool of worker threads */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tinycrypt/constants.h>
+#include <tinycrypt/utils.h>
+#include <pthread.h>
+
+/* the tasks of one _parallel call, shared by its threads */
+struct parallel_pool {
+	pthread_mutex_t lock;
+	int (*task)(void *arg, unsigned int i);
+	void *arg;
+	unsigned int next;
+	unsigned int ntasks;
+	int result;
+};
+
+/*
+ * Runs the tasks of the pool one after the other until none is left, or
+ * until one of them fails.
+ */
+static void *worker(void *p)
+{
+	struct parallel_pool *pool = (struct parallel_pool *) p;
+	unsigned int i;
+
+	for (;;) {
+		(void)pthread_mutex_lock(&pool->lock);
+		i = pool->ntasks;
+		if (pool->result == TC_CRYPTO_SUCCESS &&
+		    pool->next < pool->ntasks) {
+			i = pool->next++;
+		}
+		(void)pthread_mutex_unlock(&pool->lock);
+
+		if (i == pool->ntasks) {
+			return (void *) 0;
+		}
+		if (!pool->task(pool->arg, i)) {
+			(void)pthread_mutex_lock(&pool->lock);
+			pool->result = TC_CRYPTO_FAIL;
+			(void)pthread_mutex_unlock(&pool->lock);
+		}
+	}
+}
+
+int _parallel(int (*task)(void *arg, unsigned int i), void *arg,
+	      unsigned int ntasks, unsigned int nthreads)
+{
+	pthread_t threads[TC_PARALLEL_MAX_THREADS - 1];
+	struct parallel_pool pool;
+	unsigned int started;
+	unsigned int i;
+
+	if (nthreads > ntasks) {
+		nthreads = ntasks;
+	}
+	if (nthreads > TC_PARALLEL_MAX_THREADS) {
+		nthreads = TC_PARALLEL_MAX_THREADS;
+	}
+
+	if (pthread_mutex_init(&pool.lock, (pthread_mutexattr_t *) 0) != 0) {
+		return TC_CRYPTO_FAIL;
+	}
+	pool.task = task;
+	pool.arg = arg;
+	pool.next = 0;
+	pool.ntasks = ntasks;
+	pool.result = TC_CRYPTO_SUCCESS;
+
+	/*
+	 * The calling thread is one of the workers; should fewer threads
+	 * start than asked for, those that did take over all the tasks.
+	 */
+	for (started = 0; started + 1 < nthreads; ++started) {
+		if (pthread_create(&threads[started], (pthread_attr_t *) 0,
+				   worker, &pool) != 0) {
+			break;
+		}
+	}
+	(void)worker(&pool);
+	for (i = 0; i < started; ++i) {
+		(void)pthread_join(threads[i], (void **) 0);
+	}
+
+	(void)pthread_mutex_destroy(&pool.lock);
+
+	return pool.result;
+}
@@ -32,6 +32,7 @@
 
 #include <tinycrypt/utils.h>
 #include <tinycrypt/constants.h>
+#include "aes_internal.h"
 
 #include <string.h>
 
@@ -53,6 +54,49 @@ void _set(void *to, uint8_t val, unsigned int len)
 	(void)memset(to, val, len);
 }
 
+int _tc_aes_check_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	unsigned int j;
+
+	if (jobs == (TCAesJob_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+	for (j = 0; j < njobs; ++j) {
+		if (jobs[j].sched == (TCAesKeySched_t) 0) {
+			return TC_CRYPTO_FAIL;
+		} else if (jobs[j].in == (const uint8_t *) 0) {
+			return TC_CRYPTO_FAIL;
+		} else if (jobs[j].out == (uint8_t *) 0) {
+			return TC_CRYPTO_FAIL;
+		}
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+/*
+ * The words go through memcpy, which compiles to plain loads and stores
+ * where unaligned access is allowed, and stays correct where it is not.
+ */
+void _xor(uint8_t *out, const uint8_t *a, const uint8_t *b,
+	  unsigned int len)
+{
+	unsigned long x, y;
+
+	for (; len >= sizeof(x); len -= sizeof(x)) {
+		(void)memcpy(&x, a, sizeof(x));
+		(void)memcpy(&y, b, sizeof(y));
+		x ^= y;
+		(void)memcpy(out, &x, sizeof(x));
+		out += sizeof(x);
+		a += sizeof(x);
+		b += sizeof(x);
+	}
+	while (len-- > 0) {
+		*out++ = *a++ ^ *b++;
+	}
+}
+
 /*
  * Doubles the value of a byte for values up to 127.
  */
@@ -0,0 +1,882 @@
+/* vpaes_aes.c - TinyCrypt implementation of AES with vector permutes */
+
+/*
+ *  Copyright (C) 2017 by Intel Corporation, All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *    - Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ *    - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ *    - Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * AES with the SSSE3 byte shuffle (pshufb) as the only table lookup, after
+ * M. Hamburg, "Accelerating AES with vector permute instructions" (CHES
+ * 2009). pshufb looks up 16 nibble-indexed entries held in a register, so
+ * no memory access depends on secret data and the timing does not leak
+ * through the cache.
+ *
+ * The S-box is evaluated in GF(2^8) represented as GF(2^4)[t]/(t^2+at+a),
+ * a = 2: a byte held as nibbles (i, k), standing for i t + k, is inverted
+ * with five lookups in tables of 1/x and a/x, the infinite 1/0 being
+ * represented by 0x80, which pshufb maps to zero. Two output tables indexed
+ * by the resulting nibbles give the S-box output, already converted to the
+ * basis of the next round, and two more its double for MixColumns.
+ *
+ * The state and the round keys are kept in that basis, phi for encryption
+ * and psi (phi after the inverse affine map) for decryption, with the
+ * affine constant 0x63 folded into the round keys. The schedule holds the
+ * round keys as converted 16-byte vectors in memory order; decryption runs
+ * the straightforward inverse cipher with InvMixColumns applied to its
+ * inner round keys, and gets its own tables for the four InvMixColumns
+ * multiples of the inverse.
+ */
+
+#include <tinycrypt/aes.h>
+#include <tinycrypt/constants.h>
+#include <tinycrypt/utils.h>
+#include "aes_internal.h"
+
+#include <tmmintrin.h>
+
+#define SSSE3 __attribute__((target("ssse3")))
+#define ALIGNED __attribute__((aligned(16)))
+
+/* number of blocks the multi-block functions interleave */
+#define LANES (4)
+
+/* inversion in GF(2^4)[t]/(t^2+at+a) */
+static const uint8_t k_inv[16] ALIGNED = {
+	0x80, 0x01, 0x09, 0x0e, 0x0d, 0x0b, 0x07, 0x06,
+	0x0f, 0x02, 0x0c, 0x05, 0x0a, 0x04, 0x03, 0x08
+};
+
+static const uint8_t k_ak[16] ALIGNED = {
+	0x80, 0x02, 0x01, 0x0f, 0x09, 0x05, 0x0e, 0x0c,
+	0x0d, 0x04, 0x0b, 0x0a, 0x07, 0x08, 0x06, 0x03
+};
+
+/* conversion of low and high nibbles from the standard basis to phi */
+static const uint8_t k_ipt_lo[16] ALIGNED = {
+	0x00, 0x01, 0xbc, 0xbd, 0x1e, 0x1f, 0xa2, 0xa3,
+	0x11, 0x10, 0xad, 0xac, 0x0f, 0x0e, 0xb3, 0xb2
+};
+
+static const uint8_t k_ipt_hi[16] ALIGNED = {
+	0x00, 0x29, 0xdc, 0xf5, 0x23, 0x0a, 0xff, 0xd6,
+	0xfd, 0xd4, 0x21, 0x08, 0xde, 0xf7, 0x02, 0x2b
+};
+
+/* conversion of low and high nibbles from phi back to the standard basis */
+static const uint8_t k_opt_lo[16] ALIGNED = {
+	0x00, 0x01, 0xe0, 0xe1, 0x5d, 0x5c, 0xbd, 0xbc,
+	0xb0, 0xb1, 0x50, 0x51, 0xed, 0xec, 0x0d, 0x0c
+};
+
+static const uint8_t k_opt_hi[16] ALIGNED = {
+	0x00, 0x09, 0xa1, 0xa8, 0x83, 0x8a, 0x22, 0x2b,
+	0x47, 0x4e, 0xe6, 0xef, 0xc4, 0xcd, 0x65, 0x6c
+};
+
+/* conversion of low and high nibbles from the standard basis to psi */
+static const uint8_t k_dipt_lo[16] ALIGNED = {
+	0x00, 0x8e, 0xca, 0x44, 0xcc, 0x42, 0x06, 0x88,
+	0xb6, 0x38, 0x7c, 0xf2, 0x7a, 0xf4, 0xb0, 0x3e
+};
+
+static const uint8_t k_dipt_hi[16] ALIGNED = {
+	0x00, 0x3f, 0x33, 0x0c, 0x68, 0x57, 0x5b, 0x64,
+	0xc3, 0xfc, 0xf0, 0xcf, 0xab, 0x94, 0x98, 0xa7
+};
+
+/* S-box output, and its double, in phi, from the inverse nibbles io and jo */
+static const uint8_t k_sb1u[16] ALIGNED = {
+	0x00, 0x09, 0x2a, 0x32, 0xcf, 0xde, 0x18, 0x11,
+	0x3b, 0xf4, 0xc6, 0xec, 0xd7, 0xe5, 0xfd, 0x23
+};
+
+static const uint8_t k_sb1t[16] ALIGNED = {
+	0x00, 0x4a, 0x21, 0x12, 0x80, 0xf9, 0x33, 0x79,
+	0x58, 0xd8, 0xca, 0xeb, 0xb3, 0xa1, 0x92, 0x6b
+};
+
+static const uint8_t k_sb2u[16] ALIGNED = {
+	0x00, 0xc6, 0x3b, 0xd4, 0x51, 0x78, 0xef, 0x29,
+	0x12, 0x43, 0x97, 0xac, 0xbe, 0x6a, 0x85, 0xfd
+};
+
+static const uint8_t k_sb2t[16] ALIGNED = {
+	0x00, 0x06, 0xa6, 0xce, 0x4e, 0x20, 0x68, 0x6e,
+	0xc8, 0x86, 0x48, 0xee, 0x26, 0xe8, 0x80, 0xa0
+};
+
+/* S-box output of the last round, in the standard basis */
+static const uint8_t k_sbou[16] ALIGNED = {
+	0x00, 0xb1, 0xf1, 0x48, 0xc8, 0xc0, 0xb9, 0x08,
+	0xf9, 0x31, 0x79, 0x88, 0x71, 0x39, 0x80, 0x40
+};
+
+static const uint8_t k_sbot[16] ALIGNED = {
+	0x00, 0xd3, 0xa0, 0xe9, 0x47, 0xdd, 0x49, 0x9a,
+	0x3a, 0x7d, 0x94, 0x34, 0x0e, 0xe7, 0xae, 0x73
+};
+
+/* 9, 13, 11 and 14 times the inverse, in psi, for InvMixColumns */
+static const uint8_t k_dsb9u[16] ALIGNED = {
+	0x00, 0x17, 0xfc, 0x80, 0xb9, 0xd2, 0x7c, 0x6b,
+	0x97, 0x2e, 0xae, 0x52, 0xc5, 0x45, 0x39, 0xeb
+};
+
+static const uint8_t k_dsb9t[16] ALIGNED = {
+	0x00, 0x99, 0xbd, 0x74, 0x5b, 0x0b, 0xc9, 0x50,
+	0xed, 0xb6, 0xc2, 0x7f, 0x92, 0xe6, 0x2f, 0x24
+};
+
+static const uint8_t k_dsbdu[16] ALIGNED = {
+	0x00, 0xab, 0x94, 0x47, 0x4e, 0x36, 0xd3, 0x78,
+	0xec, 0xa2, 0xe5, 0x71, 0x9d, 0xda, 0x09, 0x3f
+};
+
+static const uint8_t k_dsbdt[16] ALIGNED = {
+	0x00, 0x9e, 0xbf, 0xf9, 0xa6, 0x7e, 0x46, 0xd8,
+	0x67, 0xc1, 0x38, 0x87, 0xe0, 0x19, 0x5f, 0x21
+};
+
+static const uint8_t k_dsbbu[16] ALIGNED = {
+	0x00, 0x16, 0xcf, 0x8e, 0xa3, 0xf4, 0x41, 0x57,
+	0x98, 0x3b, 0xb5, 0x7a, 0xe2, 0x6c, 0x2d, 0xd9
+};
+
+static const uint8_t k_dsbbt[16] ALIGNED = {
+	0x00, 0xd4, 0x9f, 0x68, 0x8c, 0xaf, 0xf7, 0x23,
+	0xbc, 0x30, 0x58, 0xc7, 0x7b, 0x13, 0xe4, 0x4b
+};
+
+static const uint8_t k_dsbeu[16] ALIGNED = {
+	0x00, 0xa3, 0x98, 0xe2, 0x8e, 0x57, 0x7a, 0xd9,
+	0x41, 0xcf, 0x2d, 0xb5, 0xf4, 0x16, 0x6c, 0x3b
+};
+
+static const uint8_t k_dsbet[16] ALIGNED = {
+	0x00, 0x8c, 0xbc, 0x7b, 0x68, 0x23, 0xc7, 0x4b,
+	0xf7, 0x9f, 0xe4, 0x58, 0xaf, 0xd4, 0x13, 0x30
+};
+
+/* inverse of the last decryption round, in the standard basis */
+static const uint8_t k_dsbou[16] ALIGNED = {
+	0x00, 0x82, 0x10, 0xc0, 0xe5, 0xb7, 0xd0, 0x52,
+	0x42, 0xa7, 0x67, 0x77, 0x35, 0xf5, 0x25, 0x92
+};
+
+static const uint8_t k_dsbot[16] ALIGNED = {
+	0x00, 0xcd, 0x6c, 0xe6, 0x65, 0x22, 0x8a, 0x47,
+	0x2b, 0x4e, 0xa8, 0xc4, 0xef, 0x09, 0x83, 0xa1
+};
+
+/* byte of row r, column c at 4c + r: ShiftRows and its inverse */
+static const uint8_t k_sr[16] ALIGNED = {
+	0x00, 0x05, 0x0a, 0x0f, 0x04, 0x09, 0x0e, 0x03,
+	0x08, 0x0d, 0x02, 0x07, 0x0c, 0x01, 0x06, 0x0b
+};
+
+static const uint8_t k_isr[16] ALIGNED = {
+	0x00, 0x0d, 0x0a, 0x07, 0x04, 0x01, 0x0e, 0x0b,
+	0x08, 0x05, 0x02, 0x0f, 0x0c, 0x09, 0x06, 0x03
+};
+
+/* rotation of every column up by one and by three rows */
+static const uint8_t k_rot1[16] ALIGNED = {
+	0x01, 0x02, 0x03, 0x00, 0x05, 0x06, 0x07, 0x04,
+	0x09, 0x0a, 0x0b, 0x08, 0x0d, 0x0e, 0x0f, 0x0c
+};
+
+static const uint8_t k_rot3[16] ALIGNED = {
+	0x03, 0x00, 0x01, 0x02, 0x07, 0x04, 0x05, 0x06,
+	0x0b, 0x08, 0x09, 0x0a, 0x0f, 0x0c, 0x0d, 0x0e
+};
+
+/* the affine constant 0x63 in the standard basis, in phi and in psi */
+#define S63 (0x63)
+#define PHI63 (0x42)
+#define PSI63 (0x1f)
+
+#define LOAD(t) _mm_load_si128((const __m128i *)(t))
+
+static inline SSSE3 __m128i load_key(const TCAesKeySched_t s, unsigned int r)
+{
+	return _mm_loadu_si128((const __m128i *)(s->words + Nb * r));
+}
+
+static inline SSSE3 void store_key(TCAesKeySched_t s, unsigned int r,
+				   __m128i k)
+{
+	_mm_storeu_si128((__m128i *)(s->words + Nb * r), k);
+}
+
+/* byte-wise linear map given by its low and high nibble tables */
+static inline SSSE3 __m128i transform(__m128i x, const uint8_t *lo,
+				      const uint8_t *hi)
+{
+	const __m128i m = _mm_set1_epi8(0x0f);
+
+	return _mm_xor_si128(
+		_mm_shuffle_epi8(LOAD(lo), _mm_and_si128(x, m)),
+		_mm_shuffle_epi8(LOAD(hi),
+				 _mm_and_si128(_mm_srli_epi16(x, 4), m)));
+}
+
+/*
+ * Inversion of the 16 bytes of x: with j = i + k, the nibbles
+ * io = j + 1/(1/i + a/k) and jo = i + 1/(1/j + a/k) of the result are the
+ * norm of x divided by k + ai and k + aj, from which the output tables
+ * recover the coordinates of 1/x.
+ */
+static inline SSSE3 void invert(__m128i x, __m128i *io, __m128i *jo)
+{
+	const __m128i m = _mm_set1_epi8(0x0f);
+	const __m128i t_inv = LOAD(k_inv);
+	__m128i i, j, k, ak, iak, jak;
+
+	i = _mm_and_si128(_mm_srli_epi16(x, 4), m);
+	k = _mm_and_si128(x, m);
+	j = _mm_xor_si128(i, k);
+	ak = _mm_shuffle_epi8(LOAD(k_ak), k);
+	iak = _mm_xor_si128(_mm_shuffle_epi8(t_inv, i), ak);
+	jak = _mm_xor_si128(_mm_shuffle_epi8(t_inv, j), ak);
+	*io = _mm_xor_si128(_mm_shuffle_epi8(t_inv, iak), j);
+	*jo = _mm_xor_si128(_mm_shuffle_epi8(t_inv, jak), i);
+}
+
+static inline SSSE3 __m128i lookup(__m128i io, __m128i jo, const uint8_t *u,
+				   const uint8_t *t)
+{
+	return _mm_xor_si128(_mm_shuffle_epi8(LOAD(u), io),
+			     _mm_shuffle_epi8(LOAD(t), jo));
+}
+
+/* SubBytes in the standard basis, used by the key expansion */
+static SSSE3 __m128i sub_bytes(__m128i x)
+{
+	__m128i io, jo;
+
+	invert(transform(x, k_ipt_lo, k_ipt_hi), &io, &jo);
+
+	return _mm_xor_si128(lookup(io, jo, k_sbou, k_sbot),
+			     _mm_set1_epi8(S63));
+}
+
+/*
+ * MixColumns from A and 2A, with rotk taking in each column the byte k rows
+ * further down: 2A + 3 rot1(A) + rot2(A) + rot3(A).
+ */
+static inline SSSE3 __m128i mix_columns(__m128i a, __m128i a2)
+{
+	const __m128i rot1 = LOAD(k_rot1);
+	__m128i x0, x3;
+
+	x0 = _mm_xor_si128(a2, _mm_shuffle_epi8(a, rot1));
+	x3 = _mm_xor_si128(_mm_shuffle_epi8(a, LOAD(k_rot3)), x0);
+
+	return _mm_xor_si128(_mm_shuffle_epi8(x0, rot1), x3);
+}
+
+static inline SSSE3 __m128i encrypt_round(__m128i x, __m128i k)
+{
+	__m128i io, jo;
+
+	invert(_mm_shuffle_epi8(x, LOAD(k_sr)), &io, &jo);
+	x = mix_columns(lookup(io, jo, k_sb1u, k_sb1t),
+			lookup(io, jo, k_sb2u, k_sb2t));
+
+	return _mm_xor_si128(x, k);
+}
+
+static inline SSSE3 __m128i encrypt_last_round(__m128i x, __m128i k)
+{
+	__m128i io, jo;
+
+	invert(_mm_shuffle_epi8(x, LOAD(k_sr)), &io, &jo);
+
+	return _mm_xor_si128(lookup(io, jo, k_sbou, k_sbot), k);
+}
+
+/*
+ * InvMixColumns of the inverse Z, by Horner's rule on the rows:
+ * 14 Z + rot1(11 Z + rot1(13 Z + rot1(9 Z))).
+ */
+static inline SSSE3 __m128i decrypt_round(__m128i x, __m128i k)
+{
+	const __m128i rot1 = LOAD(k_rot1);
+	__m128i io, jo, y;
+
+	invert(_mm_shuffle_epi8(x, LOAD(k_isr)), &io, &jo);
+	y = _mm_shuffle_epi8(lookup(io, jo, k_dsb9u, k_dsb9t), rot1);
+	y = _mm_xor_si128(y, lookup(io, jo, k_dsbdu, k_dsbdt));
+	y = _mm_shuffle_epi8(y, rot1);
+	y = _mm_xor_si128(y, lookup(io, jo, k_dsbbu, k_dsbbt));
+	y = _mm_shuffle_epi8(y, rot1);
+	y = _mm_xor_si128(y, lookup(io, jo, k_dsbeu, k_dsbet));
+
+	return _mm_xor_si128(y, k);
+}
+
+static inline SSSE3 __m128i decrypt_last_round(__m128i x, __m128i k)
+{
+	__m128i io, jo;
+
+	invert(_mm_shuffle_epi8(x, LOAD(k_isr)), &io, &jo);
+
+	return _mm_xor_si128(lookup(io, jo, k_dsbou, k_dsbot), k);
+}
+
+/*
+ * n of up to LANES blocks side by side, which keeps the pipeline busy; lane
+ * l takes in[l] to out[l] under schedule s[l], all schedules having the
+ * number of rounds of s[0].
+ */
+static SSSE3 void encrypt_lanes(uint8_t *const *out, const uint8_t *const *in,
+				const TCAesKeySched_t *s, unsigned int n)
+{
+	unsigned int nr = _tc_aes_rounds(s[0]);
+	__m128i x[LANES];
+	unsigned int r, l;
+
+	for (l = 0; l < n; ++l) {
+		x[l] = _mm_loadu_si128((const __m128i *) in[l]);
+		x[l] = transform(x[l], k_ipt_lo, k_ipt_hi);
+		x[l] = _mm_xor_si128(x[l], load_key(s[l], 0));
+	}
+	for (r = 1; r < nr; ++r) {
+		for (l = 0; l < n; ++l) {
+			x[l] = encrypt_round(x[l], load_key(s[l], r));
+		}
+	}
+	for (l = 0; l < n; ++l) {
+		x[l] = encrypt_last_round(x[l], load_key(s[l], nr));
+		_mm_storeu_si128((__m128i *) out[l], x[l]);
+	}
+
+	/* zeroing out the state */
+	_set(x, 0, sizeof(x));
+}
+
+static SSSE3 void decrypt_lanes(uint8_t *const *out, const uint8_t *const *in,
+				const TCAesKeySched_t *s, unsigned int n)
+{
+	unsigned int nr = _tc_aes_rounds(s[0]);
+	__m128i x[LANES];
+	unsigned int r, l;
+
+	for (l = 0; l < n; ++l) {
+		x[l] = _mm_loadu_si128((const __m128i *) in[l]);
+		x[l] = transform(x[l], k_dipt_lo, k_dipt_hi);
+		x[l] = _mm_xor_si128(x[l], load_key(s[l], nr));
+	}
+	for (r = nr - 1; r > 0; --r) {
+		for (l = 0; l < n; ++l) {
+			x[l] = decrypt_round(x[l], load_key(s[l], r));
+		}
+	}
+	for (l = 0; l < n; ++l) {
+		x[l] = decrypt_last_round(x[l], load_key(s[l], 0));
+		_mm_storeu_si128((__m128i *) out[l], x[l]);
+	}
+
+	/* zeroing out the state */
+	_set(x, 0, sizeof(x));
+}
+
+static const uint8_t rconst[11] = {
+	0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+};
+
+/* number of key words substituted by one pass of the vector S-box */
+#define VP_KEY_WORDS (4)
+
+/*
+ * SubWord of the n <= VP_KEY_WORDS words a[] through the vector S-box, so
+ * that key setup is constant-time.
+ */
+static SSSE3 void subwords(unsigned int *a, unsigned int n)
+{
+	unsigned int t[VP_KEY_WORDS] = { 0 };
+	__m128i x;
+
+	(void)_copy((uint8_t *) t, sizeof(t), (const uint8_t *) a, Nb * n);
+	x = sub_bytes(_mm_loadu_si128((const __m128i *) t));
+	_mm_storeu_si128((__m128i *) t, x);
+	(void)_copy((uint8_t *) a, Nb * n, (const uint8_t *) t, Nb * n);
+	_set(t, 0, sizeof(t));
+}
+
+/* conversion of the round keys of an expanded schedule to phi */
+static SSSE3 void convert_schedule(TCAesKeySched_t s)
+{
+	unsigned int r;
+	__m128i x;
+
+	store_key(s, 0, transform(load_key(s, 0), k_ipt_lo, k_ipt_hi));
+	for (r = 1; r < s->rounds; ++r) {
+		x = transform(load_key(s, r), k_ipt_lo, k_ipt_hi);
+		store_key(s, r, _mm_xor_si128(x, _mm_set1_epi8(PHI63)));
+	}
+	x = _mm_xor_si128(load_key(s, r), _mm_set1_epi8(S63));
+	store_key(s, r, x);
+}
+
+/*
+ * FIPS-197 key expansion of n keys of nk words each, stored one after the
+ * other at k, into s[0..n-1]. The words are in memory order; the keys are
+ * expanded in lockstep, so that the words of up to VP_KEY_WORDS keys
+ * needing SubWord at the same step go through a single S-box pass.
+ */
+static SSSE3 void set_encrypt_keys(TCAesKeySched_t s, const uint8_t *k,
+				   unsigned int n, unsigned int nk)
+{
+	unsigned int t[VP_KEY_WORDS];
+	unsigned int g, i, j, p, rc;
+	unsigned int *w;
+
+	for (; n > 0; n -= g, s += g, k += Nb * nk * g) {
+		g = (n < VP_KEY_WORDS) ? n : VP_KEY_WORDS;
+		for (j = 0; j < g; ++j) {
+			s[j].rounds = nk + 6;
+			(void)_copy((uint8_t *) s[j].words, Nb * nk,
+				    k + Nb * nk * j, Nb * nk);
+		}
+
+		for (i = nk; i < Nb * (nk + 7); ++i) {
+			p = i % nk;
+			for (j = 0; j < g; ++j) {
+				t[j] = s[j].words[i - 1];
+				if (p == 0) {
+					t[j] = (t[j] >> 8) | (t[j] << 24);
+				}
+			}
+			if (p == 0 || (nk > 6 && p == 4)) {
+				subwords(t, g);
+			}
+			rc = (p == 0) ? rconst[i / nk] : 0;
+			for (j = 0; j < g; ++j) {
+				w = s[j].words;
+				w[i] = w[i - nk] ^ t[j] ^ rc;
+			}
+		}
+
+		for (j = 0; j < g; ++j) {
+			convert_schedule(&s[j]);
+		}
+	}
+	_set(t, 0, sizeof(t));
+}
+
+static int set_encrypt_key(TCAesKeySched_t s, const uint8_t *k,
+			   unsigned int nk)
+{
+	if (s == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (k == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (nk + 6 > TC_AES_MAX_ROUNDS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_set_encrypt_key(s, k, nk);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	set_encrypt_keys(s, k, 1, nk);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	return set_encrypt_key(s, k, Nk);
+}
+
+int tc_aes192_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	return set_encrypt_key(s, k, TC_AES192_KEY_SIZE / Nb);
+}
+
+int tc_aes256_set_encrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	return set_encrypt_key(s, k, TC_AES256_KEY_SIZE / Nb);
+}
+
+static inline SSSE3 __m128i xtime(__m128i x)
+{
+	__m128i carry = _mm_cmpgt_epi8(_mm_setzero_si128(), x);
+
+	return _mm_xor_si128(_mm_add_epi8(x, x),
+			     _mm_and_si128(carry, _mm_set1_epi8(0x1b)));
+}
+
+/* InvMixColumns in the standard basis, for the decryption round keys */
+static SSSE3 __m128i inv_mix_columns(__m128i x)
+{
+	const __m128i rot1 = LOAD(k_rot1);
+	__m128i r2, x2;
+
+	/* InvMixColumns(x) = MixColumns(x + 4 (x + rot2(x))) */
+	r2 = _mm_shuffle_epi8(_mm_shuffle_epi8(x, rot1), rot1);
+	x = _mm_xor_si128(x, xtime(xtime(_mm_xor_si128(x, r2))));
+	x2 = xtime(x);
+
+	return mix_columns(x, x2);
+}
+
+/*
+ * Converts an encryption schedule to decryption: the round keys are taken
+ * back to the standard basis, and converted to psi, with InvMixColumns
+ * applied to the inner ones.
+ */
+static SSSE3 void invert_schedule(TCAesKeySched_t s)
+{
+	unsigned int nr, r;
+	__m128i x;
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_invert_schedule(s);
+		return;
+	}
+#endif
+
+	nr = _tc_aes_rounds(s);
+	store_key(s, 0, transform(load_key(s, 0), k_opt_lo, k_opt_hi));
+	for (r = 1; r < nr; ++r) {
+		x = _mm_xor_si128(load_key(s, r), _mm_set1_epi8(PHI63));
+		x = inv_mix_columns(transform(x, k_opt_lo, k_opt_hi));
+		x = transform(x, k_dipt_lo, k_dipt_hi);
+		store_key(s, r, _mm_xor_si128(x, _mm_set1_epi8(PSI63)));
+	}
+	x = _mm_xor_si128(load_key(s, nr), _mm_set1_epi8(S63));
+	x = transform(x, k_dipt_lo, k_dipt_hi);
+	store_key(s, nr, _mm_xor_si128(x, _mm_set1_epi8(PSI63)));
+}
+
+int tc_aes128_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	if (tc_aes128_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes192_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	if (tc_aes192_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes256_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+	if (tc_aes256_set_encrypt_key(s, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	invert_schedule(s);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+/*
+ * The decryption schedule of a key pair is derived from its encryption
+ * schedule, so that the key is expanded only once.
+ */
+static int set_key_pair(TCAesKeyPair_t p, const uint8_t *k,
+			int (*set_enc)(TCAesKeySched_t, const uint8_t *))
+{
+	if (p == (TCAesKeyPair_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (set_enc(&p->enc, k) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+	p->dec = p->enc;
+	invert_schedule(&p->dec);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes128_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+	return set_key_pair(p, k, tc_aes128_set_encrypt_key);
+}
+
+int tc_aes192_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+	return set_key_pair(p, k, tc_aes192_set_encrypt_key);
+}
+
+int tc_aes256_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+	return set_key_pair(p, k, tc_aes256_set_encrypt_key);
+}
+
+/*
+ * Batch key setup: the keys are expanded together by set_encrypt_keys, and
+ * their decryption schedules derived from the encryption ones.
+ */
+static int set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		    const uint8_t *k, unsigned int n, unsigned int nk)
+{
+	unsigned int i;
+
+	if (enc == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (k == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (nk + 6 > TC_AES_MAX_ROUNDS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		for (i = 0; i < n; ++i) {
+			_tc_aesni_set_encrypt_key(&enc[i], k + Nb * nk * i, nk);
+		}
+	} else {
+		set_encrypt_keys(enc, k, n, nk);
+	}
+#else
+	set_encrypt_keys(enc, k, n, nk);
+#endif
+
+	if (dec != (TCAesKeySched_t) 0) {
+		for (i = 0; i < n; ++i) {
+			dec[i] = enc[i];
+			invert_schedule(&dec[i]);
+		}
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes128_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, Nk);
+}
+
+int tc_aes192_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, TC_AES192_KEY_SIZE / Nb);
+}
+
+int tc_aes256_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+		       const uint8_t *k, unsigned int n)
+{
+	return set_keys(enc, dec, k, n, TC_AES256_KEY_SIZE / Nb);
+}
+
+int tc_aes_encrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s)
+{
+	const uint8_t *pin[LANES];
+	uint8_t *pout[LANES];
+	TCAesKeySched_t k[LANES];
+	unsigned int n, l;
+
+	if (out == (uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (in == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (s == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_encrypt_blocks(out, in, nblocks, s);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	for (l = 0; l < LANES; ++l) {
+		k[l] = s;
+	}
+	while (nblocks > 0) {
+		n = (nblocks < LANES) ? nblocks : LANES;
+		for (l = 0; l < n; ++l) {
+			pin[l] = in + TC_AES_BLOCK_SIZE * l;
+			pout[l] = out + TC_AES_BLOCK_SIZE * l;
+		}
+		encrypt_lanes(pout, pin, k, n);
+		in += TC_AES_BLOCK_SIZE * n;
+		out += TC_AES_BLOCK_SIZE * n;
+		nblocks -= n;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_decrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s)
+{
+	const uint8_t *pin[LANES];
+	uint8_t *pout[LANES];
+	TCAesKeySched_t k[LANES];
+	unsigned int n, l;
+
+	if (out == (uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (in == (const uint8_t *) 0) {
+		return TC_CRYPTO_FAIL;
+	} else if (s == (TCAesKeySched_t) 0) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_decrypt_blocks(out, in, nblocks, s);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	for (l = 0; l < LANES; ++l) {
+		k[l] = s;
+	}
+	while (nblocks > 0) {
+		n = (nblocks < LANES) ? nblocks : LANES;
+		for (l = 0; l < n; ++l) {
+			pin[l] = in + TC_AES_BLOCK_SIZE * l;
+			pout[l] = out + TC_AES_BLOCK_SIZE * l;
+		}
+		decrypt_lanes(pout, pin, k, n);
+		in += TC_AES_BLOCK_SIZE * n;
+		out += TC_AES_BLOCK_SIZE * n;
+		nblocks -= n;
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_encrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
+{
+	return tc_aes_encrypt_blocks(out, in, 1, s);
+}
+
+int tc_aes_decrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
+{
+	return tc_aes_decrypt_blocks(out, in, 1, s);
+}
+
+/*
+ * Multi-key batches are cut into steps of up to LANES blocks, taken in order
+ * from block *b of entry *j on and each under the schedule of its entry.
+ * The blocks of a step must share their number of rounds, so an entry of
+ * another key size starts a new step. Returns the number of blocks taken.
+ */
+static unsigned int next_lanes(const uint8_t **in, uint8_t **out,
+			       TCAesKeySched_t *k, const TCAesJob_t jobs,
+			       unsigned int njobs, unsigned int *j,
+			       unsigned int *b)
+{
+	unsigned int n = 0;
+
+	for (; *j < njobs && n < LANES; ++*j, *b = 0) {
+		if (n > 0 && jobs[*j].nblocks > 0 &&
+		    _tc_aes_rounds(jobs[*j].sched) != _tc_aes_rounds(k[0])) {
+			break;
+		}
+		for (; *b < jobs[*j].nblocks && n < LANES; ++*b, ++n) {
+			in[n] = jobs[*j].in + TC_AES_BLOCK_SIZE * *b;
+			out[n] = jobs[*j].out + TC_AES_BLOCK_SIZE * *b;
+			k[n] = jobs[*j].sched;
+		}
+		if (*b < jobs[*j].nblocks) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+int tc_aes_encrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	const uint8_t *in[LANES];
+	uint8_t *out[LANES];
+	TCAesKeySched_t k[LANES];
+	unsigned int n;
+	unsigned int j = 0, p = 0;
+
+	if (_tc_aes_check_jobs(jobs, njobs) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_encrypt_jobs(jobs, njobs);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	while ((n = next_lanes(in, out, k, jobs, njobs, &j, &p)) > 0) {
+		encrypt_lanes(out, in, k, n);
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_decrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+	const uint8_t *in[LANES];
+	uint8_t *out[LANES];
+	TCAesKeySched_t k[LANES];
+	unsigned int n;
+	unsigned int j = 0, p = 0;
+
+	if (_tc_aes_check_jobs(jobs, njobs) != TC_CRYPTO_SUCCESS) {
+		return TC_CRYPTO_FAIL;
+	}
+
+#ifdef TINYCRYPT_ARCH_HAS_AESNI
+	if (_tc_aesni_available()) {
+		_tc_aesni_decrypt_jobs(jobs, njobs);
+		return TC_CRYPTO_SUCCESS;
+	}
+#endif
+
+	while ((n = next_lanes(in, out, k, jobs, njobs, &j, &p)) > 0) {
+		decrypt_lanes(out, in, k, n);
+	}
+
+	return TC_CRYPTO_SUCCESS;
+}
@@ -33,34 +33,165 @@
 #include <tinycrypt/aes.h>
 #include <tinycrypt/constants.h>
 #include <tinycrypt/utils.h>
+#include "aes_internal.h"
+
+/* Apply InvMixColumns to all but the first and last round keys. */
+static void invert_schedule(TCAesKeySched_t s) {
+    unsigned int *w = s->words;
+
+    for (unsigned int i = Nb; i < Nb * s->rounds; i++) {
+        w[i] = aes_mix_inv(w[i]);
+    }
+}
 
 int tc_aes128_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
 {
-	if (s == (TCAesKeySched_t) 0) {
-		return TC_CRYPTO_FAIL;
-	} else if (k == (const uint8_t *) 0) {
-		return TC_CRYPTO_FAIL;
-	}
+    if (tc_aes128_set_encrypt_key(s, k) == TC_CRYPTO_FAIL) {
+        return TC_CRYPTO_FAIL;
+    }
+
+    invert_schedule(s);
+
+    return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes192_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+    if (tc_aes192_set_encrypt_key(s, k) == TC_CRYPTO_FAIL) {
+        return TC_CRYPTO_FAIL;
+    }
+
+    invert_schedule(s);
+
+    return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes256_set_decrypt_key(TCAesKeySched_t s, const uint8_t *k)
+{
+    if (tc_aes256_set_encrypt_key(s, k) == TC_CRYPTO_FAIL) {
+        return TC_CRYPTO_FAIL;
+    }
+
+    invert_schedule(s);
+
+    return TC_CRYPTO_SUCCESS;
+}
+
+/*
+ * The decryption schedule of a key pair is derived from its encryption
+ * schedule, so that the key is expanded only once.
+ */
+static int set_key_pair(TCAesKeyPair_t p, const uint8_t *k,
+                        int (*set_encrypt_key)(TCAesKeySched_t, const uint8_t *)) {
+    if (p == (TCAesKeyPair_t) 0) {
+        return TC_CRYPTO_FAIL;
+    }
+    if (set_encrypt_key(&p->enc, k) == TC_CRYPTO_FAIL) {
+        return TC_CRYPTO_FAIL;
+    }
+
+    p->dec = p->enc;
+    invert_schedule(&p->dec);
+
+    return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes128_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+    return set_key_pair(p, k, tc_aes128_set_encrypt_key);
+}
 
-    tc_aes128_set_encrypt_key(s, k);
+int tc_aes192_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+    return set_key_pair(p, k, tc_aes192_set_encrypt_key);
+}
 
-    int32_t *w = (int32_t *) s;
+int tc_aes256_set_key_pair(TCAesKeyPair_t p, const uint8_t *k)
+{
+    return set_key_pair(p, k, tc_aes256_set_encrypt_key);
+}
 
-    for (int i = 1; i < Nr; i++) {
-        int j = i * 4;
+/*
+ * Batch key setup: this engine has no parallel key expansion, so the keys
+ * are set one at a time, and their decryption schedules derived from the
+ * encryption ones.
+ */
+static int set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+                    const uint8_t *k, unsigned int n, unsigned int keylen,
+                    int (*set_encrypt_key)(TCAesKeySched_t, const uint8_t *)) {
+    unsigned int i;
+
+    if (enc == (TCAesKeySched_t) 0) {
+        return TC_CRYPTO_FAIL;
+    } else if (k == (const uint8_t *) 0) {
+        return TC_CRYPTO_FAIL;
+    }
 
-        w[j]     = aes_mix_inv(w[j]);
-        w[j + 1] = aes_mix_inv(w[j + 1]);
-        w[j + 2] = aes_mix_inv(w[j + 2]);
-        w[j + 3] = aes_mix_inv(w[j + 3]);
+    for (i = 0; i < n; ++i) {
+        if (set_encrypt_key(&enc[i], k + keylen * i) !=
+            TC_CRYPTO_SUCCESS) {
+            return TC_CRYPTO_FAIL;
+        }
+    }
+
+    if (dec != (TCAesKeySched_t) 0) {
+        for (i = 0; i < n; ++i) {
+            dec[i] = enc[i];
+            invert_schedule(&dec[i]);
+        }
     }
 
     return TC_CRYPTO_SUCCESS;
 }
 
+int tc_aes128_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+                       const uint8_t *k, unsigned int n)
+{
+    return set_keys(enc, dec, k, n, TC_AES_KEY_SIZE,
+                    tc_aes128_set_encrypt_key);
+}
+
+int tc_aes192_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+                       const uint8_t *k, unsigned int n)
+{
+    return set_keys(enc, dec, k, n, TC_AES192_KEY_SIZE,
+                    tc_aes192_set_encrypt_key);
+}
+
+int tc_aes256_set_keys(TCAesKeySched_t enc, TCAesKeySched_t dec,
+                       const uint8_t *k, unsigned int n)
+{
+    return set_keys(enc, dec, k, n, TC_AES256_KEY_SIZE,
+                    tc_aes256_set_encrypt_key);
+}
+
 int tc_aes_decrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
 {
-    aes_dec(out, in, s->words);
+    aes_dec(out, in, s->words, _tc_aes_rounds(s));
 
 	return TC_CRYPTO_SUCCESS;
 }
+
+int tc_aes_decrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s)
+{
+    aes_dec_blocks(out, in, s->words, _tc_aes_rounds(s), nblocks);
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_decrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+    unsigned int j;
+
+    if (_tc_aes_check_jobs(jobs, njobs) != TC_CRYPTO_SUCCESS) {
+        return TC_CRYPTO_FAIL;
+    }
+
+    for (j = 0; j < njobs; ++j) {
+        aes_dec_blocks(jobs[j].out, jobs[j].in, jobs[j].sched->words,
+                       _tc_aes_rounds(jobs[j].sched), jobs[j].nblocks);
+    }
+
+    return TC_CRYPTO_SUCCESS;
+}
@@ -33,6 +33,8 @@
 #include <tinycrypt/aes.h>
 #include <tinycrypt/utils.h>
 #include <tinycrypt/constants.h>
+#include "aes_internal.h"
+#include <string.h>
 
 static inline unsigned int rotword(unsigned int a)
 {
@@ -75,18 +77,67 @@ void aes_enc_exp_step( uint8_t* r, const uint8_t* rk, uint8_t rcon ) {
     (r)[ 12 ] = (x)[  3 ]; (r)[ 13 ] = (x)[  7 ]; (r)[ 14 ] = (x)[ 11 ]; (r)[ 15 ] = (x)[ 15 ]; \
 }
 
-int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t* k) {
+/*
+ * Generic byte-wise expansion for the 192 and 256-bit keys; the schedule
+ * is kept in memory byte order, as aes_enc_exp_step does for 128-bit keys.
+ */
+static void expand_key(uint8_t *rp, const uint8_t *k, unsigned int nk,
+                       unsigned int nr) {
+    uint8_t rcp[9] = {
+        0x8D, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+    };
+    uint8_t t[4];
+
+    memcpy(rp, k, 4 * nk);
+
+    for (unsigned int i = nk; i < Nb * (nr + 1); i++) {
+        const uint8_t *p = rp + 4 * (i - 1);
+
+        if (i % nk == 0) {
+            t[0] = (uint8_t) aes_sub(p[1]) ^ rcp[i / nk];
+            t[1] = (uint8_t) aes_sub(p[2]);
+            t[2] = (uint8_t) aes_sub(p[3]);
+            t[3] = (uint8_t) aes_sub(p[0]);
+        } else if (nk > 6 && i % nk == 4) {
+            t[0] = (uint8_t) aes_sub(p[0]);
+            t[1] = (uint8_t) aes_sub(p[1]);
+            t[2] = (uint8_t) aes_sub(p[2]);
+            t[3] = (uint8_t) aes_sub(p[3]);
+        } else {
+            t[0] = p[0]; t[1] = p[1]; t[2] = p[2]; t[3] = p[3];
+        }
+
+        rp[4 * i + 0] = rp[4 * (i - nk) + 0] ^ t[0];
+        rp[4 * i + 1] = rp[4 * (i - nk) + 1] ^ t[1];
+        rp[4 * i + 2] = rp[4 * (i - nk) + 2] ^ t[2];
+        rp[4 * i + 3] = rp[4 * (i - nk) + 3] ^ t[3];
+    }
+}
+
+static int set_encrypt_key(TCAesKeySched_t s, const uint8_t* k,
+                           unsigned int nk) {
     uint8_t rcp[11] = {
         0x8D, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
         0x80, 0x1B, 0x36
     };
-    uint8_t*  rp = s->words;
+    uint8_t*  rp;
 
 	if (s == (TCAesKeySched_t) 0) {
 		return TC_CRYPTO_FAIL;
 	} else if (k == (const uint8_t *) 0) {
 		return TC_CRYPTO_FAIL;
+	} else if (nk + 6 > TC_AES_MAX_ROUNDS) {
+		return TC_CRYPTO_FAIL;
 	}
+
+    rp = (uint8_t*) s->words;
+    s->rounds = nk + 6;
+
+    if (nk != Nk) {
+        expand_key(rp, k, nk, s->rounds);
+
+        return TC_CRYPTO_SUCCESS;
+    }
     
     U8_TO_U8_N(rp, k);
     
@@ -99,9 +150,45 @@ int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t* k) {
     return TC_CRYPTO_SUCCESS;
 }
 
+int tc_aes128_set_encrypt_key(TCAesKeySched_t s, const uint8_t* k) {
+    return set_encrypt_key(s, k, Nk);
+}
+
+int tc_aes192_set_encrypt_key(TCAesKeySched_t s, const uint8_t* k) {
+    return set_encrypt_key(s, k, TC_AES192_KEY_SIZE / Nb);
+}
+
+int tc_aes256_set_encrypt_key(TCAesKeySched_t s, const uint8_t* k) {
+    return set_encrypt_key(s, k, TC_AES256_KEY_SIZE / Nb);
+}
+
 int tc_aes_encrypt(uint8_t *out, const uint8_t *in, const TCAesKeySched_t s)
 {
-    aes_enc(out, in, s->words);
+    aes_enc(out, in, s->words, _tc_aes_rounds(s));
+
+	return TC_CRYPTO_SUCCESS;
+}
+
+int tc_aes_encrypt_blocks(uint8_t *out, const uint8_t *in,
+			  unsigned int nblocks, const TCAesKeySched_t s)
+{
+    aes_enc_blocks(out, in, s->words, _tc_aes_rounds(s), nblocks);
 
 	return TC_CRYPTO_SUCCESS;
 }
+
+int tc_aes_encrypt_jobs(const TCAesJob_t jobs, unsigned int njobs)
+{
+    unsigned int j;
+
+    if (_tc_aes_check_jobs(jobs, njobs) != TC_CRYPTO_SUCCESS) {
+        return TC_CRYPTO_FAIL;
+    }
+
+    for (j = 0; j < njobs; ++j) {
+        aes_enc_blocks(jobs[j].out, jobs[j].in, jobs[j].sched->words,
+                       _tc_aes_rounds(jobs[j].sched), jobs[j].nblocks);
+    }
+
+    return TC_CRYPTO_SUCCESS;
+}